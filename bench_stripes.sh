@@ -0,0 +1,71 @@
+#!/bin/bash
+# bench_stripes.sh :
+#   * Runs an eviction-heavy workload on a striped disk with 1, 2, 4 and 8 stripes
+#   * Prints the wall clock time and simulated disk time of each run, and the
+#     speedup of each over one stripe
+
+# Usage
+usage() {
+echo "usage:  bench_stripes.sh [-p pages] [-f frames] [-l latency] [-u stripe_unit] [-d disk] [-w workload]"
+echo "  -p pages:       number of pages (default 20000)"
+echo "  -f frames:      number of frames (default 2000)"
+echo "  -l latency:     simulated storage model, hdd, ssd or none (default hdd)"
+echo "  -u stripe_unit: blocks per stripe unit (default 1)"
+echo "  -d disk:        file or direct (default file)"
+echo "  -w workload:    program and options (default \"uniform ops=200000 writes=50\")"
+}
+
+# Variable definitions
+declare -a STRIPES=(1 2 4 8)
+PAGES=20000
+FRAMES=2000
+LATENCY=hdd
+UNIT=1
+DISK=file
+WORKLOAD="uniform ops=200000 writes=50"
+
+while getopts 'p:f:l:u:d:w:h' flag; do
+    case "${flag}" in
+        p) PAGES=${OPTARG} ;;
+        f) FRAMES=${OPTARG} ;;
+        l) LATENCY=${OPTARG} ;;
+        u) UNIT=${OPTARG} ;;
+        d) DISK=${OPTARG} ;;
+        w) WORKLOAD=${OPTARG} ;;
+        *)
+            usage
+            exit 1
+        ;;
+    esac
+done
+
+if [ ! -x ./virtmem ]; then
+    echo "build virtmem with make first"
+    exit 1
+fi
+
+printf "STRIPES, NUM_FAULTS, DISK_READS, DISK_WRITES, WALL_MS, SIM_DISK_NS, WALL_SPEEDUP, SIM_SPEEDUP \n"
+
+for n in "${STRIPES[@]}"
+do
+    start=$(date +%s%N)
+    output=$(./virtmem $PAGES $FRAMES rand $WORKLOAD disk=$DISK latency=$LATENCY stripes=$n stripe_unit=$UNIT)
+    if [ $? -ne 0 ]; then
+        echo "virtmem failed with $n stripes"
+        exit 1
+    fi
+    end=$(date +%s%N)
+
+    wall=$(( (end - start) / 1000000 ))
+    sim=$(echo "$output" | grep "SIM_DISK_NS" | cut -d ' ' -f 2)
+    counts=$(echo "$output" | grep "," | head -1)
+    if [ $n -eq 1 ]; then
+        base_wall=$wall
+        base_sim=$sim
+    fi
+
+    printf "%d, %s, %d, %s, " $n "$counts" $wall $sim
+    awk "BEGIN { printf \"%.2f, %.2f \\n\", ($wall ? $base_wall / $wall : 1), ($sim ? $base_sim / $sim : 1) }"
+done
+
+rm -f myvirtualdisk.[0-9]
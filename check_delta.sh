@@ -0,0 +1,46 @@
+#!/bin/bash
+# check_delta.sh :
+#   * Checks that the sector hash catches every single-bit change of a frame
+#   * Runs programs with and without delta write-back on each disk backend
+#   * Fails if the program result differs: delta=1 must only change how
+#     much is written, never what is read back
+
+declare -a RUNS=(
+    "1000 200 rand uniform ops=100000 writes=50"
+    "100 40 fifo uniform ops=20000 writes=50"
+    "200 50 fifo zipf ops=50000 writes=30"
+    "100 30 rand sort"
+    "100 30 custom focus"
+    "100 30 fifo hash"
+)
+declare -a DISKS=("disk=file" "disk=direct" "disk=file swap=log")
+
+if [ ! -x ./virtmem ]; then
+    echo "build virtmem with make first"
+    exit 1
+fi
+
+failed=0
+if ./virtmem 10 5 rand scan delta=check; then
+    printf "ok    sector hash bit flips \n"
+else
+    printf "FAIL  sector hash bit flips \n"
+    failed=1
+fi
+
+for run in "${RUNS[@]}"
+do
+    for disk in "${DISKS[@]}"
+    do
+        plain=$(./virtmem $run $disk delta=0 | grep "result")
+        delta=$(./virtmem $run $disk delta=1 | grep "result")
+        if [ -z "$plain" ] || [ "$plain" != "$delta" ]; then
+            printf "FAIL  %s %s: delta=0 gives '%s', delta=1 gives '%s' \n" "$run" "$disk" "$plain" "$delta"
+            failed=1
+        else
+            printf "ok    %s %s \n" "$run" "$disk"
+        fi
+    done
+done
+
+exit $failed
@@ -0,0 +1,39 @@
+#!/bin/bash
+# check_regions.sh :
+#   * Runs programs with and without region-based victim selection
+#   * Fails if a run does not finish in time or the program result differs:
+#     regions=N may only change which pages are evicted, never what is read
+
+declare -a RUNS=(
+    "200 60 fifo sort"
+    "300 80 fifo sort"
+    "300 80 fifo sort-hinted"
+    "300 80 rand sort"
+    "200 60 fifo scan"
+    "200 60 fifo focus"
+)
+declare -a REGIONS=(3 8)
+LIMIT=60
+
+if [ ! -x ./virtmem ]; then
+    echo "build virtmem with make first"
+    exit 1
+fi
+
+failed=0
+for run in "${RUNS[@]}"
+do
+    plain=$(timeout $LIMIT ./virtmem $run | grep "result")
+    for n in "${REGIONS[@]}"
+    do
+        regions=$(timeout $LIMIT ./virtmem $run regions=$n | grep "result")
+        if [ -z "$plain" ] || [ "$plain" != "$regions" ]; then
+            printf "FAIL  %s regions=%d: plain gives '%s', regions gives '%s' \n" "$run" $n "$plain" "$regions"
+            failed=1
+        else
+            printf "ok    %s regions=%d \n" "$run" $n
+        fi
+    done
+done
+
+exit $failed
@@ -1,12 +1,29 @@
 /*
-Do not modify this file.
-Make all of your changes to main.c instead.
+Virtual disk that holds pages while they are not resident.
+The disk is an array of BLOCK_SIZE blocks kept on one of several
+backends, optionally striped across files or laid out as a log, and
+every access can be charged to a simulated storage latency model.
 */
 
 #ifndef DISK_H
 #define DISK_H
 
 #define BLOCK_SIZE 4096
+#define DISK_SECTOR_SIZE 512
+#define DISK_SECTORS_PER_BLOCK (BLOCK_SIZE/DISK_SECTOR_SIZE)
+
+/*
+Storage backends for a virtual disk.
+DISK_BACKEND_FILE  pread/pwrite through the page cache (the default).
+DISK_BACKEND_RAM   a preallocated in-memory arena; no file is touched.
+DISK_BACKEND_MMAP  the file is mapped and blocks are copied with memcpy.
+DISK_BACKEND_DIRECT pread/pwrite with O_DIRECT, bypassing the page cache.
+*/
+
+#define DISK_BACKEND_FILE   0
+#define DISK_BACKEND_RAM    1
+#define DISK_BACKEND_MMAP   2
+#define DISK_BACKEND_DIRECT 3
 
 /*
 Create a new virtual disk in the file "filename", with the given number of blocks.
@@ -15,6 +32,90 @@ Returns a pointer to a new disk object, or null on failure.
 
 struct disk * disk_open( const char *filename, int blocks );
 
+/*
+Like disk_open, but store the blocks using the given DISK_BACKEND_* backend.
+Returns a pointer to a new disk object, or null on failure.
+*/
+
+struct disk * disk_open_backend( const char *filename, int blocks, int backend );
+
+/*
+Like disk_open_backend, but spread the blocks over "nstripes" files
+named "filename.0", "filename.1" and so on, which may be links onto
+different devices.  Blocks are dealt round-robin in runs of
+"stripe_unit" blocks.  Each stripe has its own I/O thread: writes are
+queued and return at once, reads wait only for their own stripe, and
+disk_read_batch fetches from all stripes in parallel.  The latency
+model keeps a separate queue and head position per stripe.
+"backend" must be DISK_BACKEND_FILE or DISK_BACKEND_DIRECT, and a
+striped disk supports neither the log layout, disk_clone nor disk_fd.
+Returns a pointer to a new disk object, or null on failure.
+*/
+
+struct disk * disk_open_striped( const char *filename, int blocks, int backend, int nstripes, int stripe_unit );
+
+/*
+Return the DISK_BACKEND_* value for a backend name
+("file", "ram", "mmap" or "direct"), or -1 if the name is unknown.
+*/
+
+int disk_backend_from_name( const char *name );
+
+/*
+Simulated storage latency model.
+Every I/O is charged io_ns, plus a seek of seek_ns + seek_ns_per_block
+per block of distance (capped at max_seek_ns) when it does not follow
+the previous I/O, plus ns_per_byte for the transfer.  Reads are
+synchronous; writes are write-back and overlap up to queue_depth deep,
+so each is charged 1/queue_depth of its cost.
+*/
+
+struct disk_latency {
+	long long io_ns;
+	long long seek_ns;
+	long long seek_ns_per_block;
+	long long max_seek_ns;
+	double ns_per_byte;
+	int queue_depth;
+};
+
+/*
+Fill "model" with a preset: "hdd", "ssd" or "none".
+Returns 0 on success or -1 if the name is unknown.
+*/
+
+int disk_latency_from_name( const char *name, struct disk_latency *model );
+
+/* Start charging I/O on "d" against "model". Passing null turns the model off. */
+
+void disk_set_latency( struct disk *d, const struct disk_latency *model );
+
+/*
+Charge a read or write of one whole block to the latency model without
+moving any data, for I/O that reached the disk file some other way,
+such as through a shared mapping.
+*/
+
+void disk_charge_block( struct disk *d, int block, int write );
+
+/* Return the simulated nanoseconds spent in I/O on "d" so far. */
+
+long long disk_elapsed_ns( struct disk *d );
+
+/*
+Switch "d" to a log-structured layout with segments of "segment_blocks"
+blocks.  Writes are appended sequentially to the current segment and a
+block-to-slot table remembers where each block lives; disk_read and
+disk_write keep their meaning.  Must be called before any I/O.
+Returns 0 on success or -1 on failure.
+*/
+
+int disk_set_log_layout( struct disk *d, int segment_blocks );
+
+/* Report how many segments the log cleaner compacted and how many live blocks it copied. */
+
+void disk_log_stats( struct disk *d, long long *segments_cleaned, long long *blocks_moved );
+
 /*
 Write exactly BLOCK_SIZE bytes to a given block on the virtual disk.
 "d" must be a pointer to a virtual disk, "block" is the block number,
@@ -23,6 +124,15 @@ and "data" is a pointer to the data to write.
 
 void disk_write( struct disk *d, int block, const char *data );
 
+/*
+Write only the sectors of a block whose bit is set in "mask"
+(bit i covers bytes i*DISK_SECTOR_SIZE up to the next sector of "data").
+Contiguous runs of sectors go out as a single write.
+Returns the number of bytes written.
+*/
+
+int disk_write_sectors( struct disk *d, int block, const char *data, unsigned mask );
+
 /*
 Read exactly BLOCK_SIZE bytes from a given block on the virtual disk.
 "d" must be a pointer to a virtual disk, "block" is the block number,
@@ -31,6 +141,32 @@ and "data" is a pointer to where the data will be placed.
 
 void disk_read( struct disk *d, int block, char *data );
 
+/*
+Read "count" blocks: blocks[i] is placed at data[i].
+Runs of consecutive block numbers are fetched with one vectored read,
+so callers should pass blocks in ascending order.
+*/
+
+void disk_read_batch( struct disk *d, const int *blocks, char **data, int count );
+
+/*
+Give "d" a private copy of its current contents in the file "filename"
+and carry on using the copy, with fresh latency and cleaner statistics.
+The copy is a reflink where the filesystem supports it, so it costs no
+I/O until either side writes.  The ram backend relies on the copy-on-write
+memory of fork() and needs no file.
+Returns 0 on success or -1 on failure.
+*/
+
+int disk_clone( struct disk *d, const char *filename );
+
+/*
+Return the file descriptor holding the blocks of "d" at offset
+block*BLOCK_SIZE, or -1 for the ram backend.
+*/
+
+int disk_fd( struct disk *d );
+
 /*
 Return the number of blocks in the virtual disk.
 */
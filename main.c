@@ -6,10 +6,15 @@ The header files page_table.h and disk.h explain
 how to use the page table and disk interfaces.
 */
 
+#define _GNU_SOURCE
+
 // Custom header files
 #include "page_table.h"
 #include "disk.h"
 #include "program.h"
+#include "workload.h"
+#include "trace.h"
+#include "stats.h"
 
 // Standard includes
 #include <stdio.h>
@@ -18,6 +23,9 @@ how to use the page table and disk interfaces.
 #include <time.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 
 // Globals
 int NFRAMES;
@@ -30,22 +38,125 @@ char *PHYSMEM;
 #ifndef FRAME_SIZE
 #define FRAME_SIZE 4096
 #endif
-int NUM_PAGE_FAULTS;
-int NUM_DISK_READS;
-int NUM_DISK_WRITES;
-int TIME_STAMP_SIZE;
+long long NUM_PAGE_FAULTS;
+long long NUM_DISK_READS;
+long long NUM_DISK_WRITES;
+long long NUM_BYTES_WRITTEN;
+struct workload_options WORKLOAD_OPTS;
+int DISK_BACKEND;
+int DISK_STRIPES;
+int DISK_STRIPE_UNIT;
+struct disk_latency LATENCY;
+bool LATENCY_ENABLED;
+long long FAULT_CPU_NS;
+long long SIM_DISK_NS;
+bool DELTA_WRITEBACK;
+bool DELTA_CHECK;
+int LOG_SEGMENT_BLOCKS;
+long long LOG_SEGMENTS_CLEANED;
+long long LOG_BLOCKS_MOVED;
+unsigned long long *SECTOR_SUMS;
+const char *WARM_START_FILE;
+int WARM_START_PAGES;
+long long WARM_START_WRITES;
+long long STARTUP_FAULTS;
+bool WRITE_FAULTS;
+long long NUM_DIRECT_WRITE_MAPS;
+int TIER_FAST_FRAMES;
+long long TIER_FAST_NS;
+long long TIER_SLOW_NS;
+long long TIER_MIGRATE_NS;
+int TIER_SAMPLE_INTERVAL;
+int TIER_PROMOTE_REFS;
+unsigned int TIER_SEED;
+long long TIER_FAST_HITS;
+long long TIER_SLOW_HITS;
+long long TIER_PROMOTIONS;
+long long TIER_DEMOTIONS;
+long long TIER_SAMPLE_FAULTS;
+int RECLAIM_LOW;
+int RECLAIM_HIGH;
+long long RECLAIM_BATCHES;
+long long RECLAIM_FRAMES;
+long long INLINE_RECLAIMS;
+int NUM_REGIONS;
+int REGION_PAGES;
+struct region *REGION_TABLE;
+unsigned char *PAGE_EVICTED;
+long long REGION_SEQ_VICTIMS;
+long long REGION_LOOP_VICTIMS;
+bool STATS_ENABLED;
+struct virtmem_stats *STATS;
+struct page_table *PAGE_TABLE;
+const char *CHECKPOINT_NAME;
+#define FORK_MAX_CONFIGS 16
+int FORK_COUNT;
+char FORK_POLICIES[FORK_MAX_CONFIGS][16];
+int FORK_FRAMES[FORK_MAX_CONFIGS];
+char FORK_DISK_NAME[64];
+bool ZERO_COPY;
+bool FAULT_TIMING;
+long long NUM_BYTES_COPIED;
+long long FAULT_NS;
+long long TIMED_FAULTS;
+unsigned char *PAGE_HINTS;
+int NUM_PINNED_FRAMES;
+long long HINT_READAHEAD_PAGES;
+long long HINT_DROP_BEHIND;
+long long HINT_PREFETCHED;
+long long HINT_DROPPED;
+long long HINT_SKIPPED_READS;
+
+// Per-page advice from page_table_madvise
+#define PAGE_HINT_SEQUENTIAL 0x1 // read ahead of faults and drop behind them
+#define PAGE_HINT_ZERO       0x2 // contents are dead, so the next load zero-fills
+#define PAGE_HINT_PIN        0x4 // pin the page's frame whenever it is resident
+#define READAHEAD_PAGES      8   // pages read ahead of a sequential fault
+
+// Region access patterns
+#define REGION_RANDOM     0 // no clear pattern, the global policy decides
+#define REGION_SEQUENTIAL 1 // streaming through pages that are not reused
+#define REGION_LOOPING    2 // sweeping repeatedly over the same pages
+#define REGION_WINDOW     16 // faults per classification window
+#define REGION_RECENT     2 // newest loads kept out of region victims
+
+// Fault stream of one region of the virtual address space
+struct region {
+    int last_page;      // page of the previous fault in the region
+    int faults;         // faults so far in the current window
+    int sequential;     // faults next to the previous one
+    int refaults;       // faults on pages that were evicted before
+    int pattern;        // REGION_* from the last full window
+};
 
 /*
  * Frame Table Struct Creation
  * --------------------
+ * One packed descriptor per frame keeps everything the handler needs
+ * about a frame on a single cache line (five frames per 64 bytes).
  */
 
+// Frame descriptor flags
+#define FRAME_USED  0x1 // frame holds a page
+#define FRAME_DIRTY 0x2 // page was written since it was loaded
+#define FRAME_SAMPLED 0x4 // page is unmapped to catch its next reference
+#define FRAME_PINNED  0x8 // frame must not be chosen as a victim
+
+// Frame Descriptor
+struct frame {
+    int page;               // page held by the frame (reverse map to the page table)
+    unsigned short flags;   // FRAME_* bits
+    unsigned short refs;    // sampled references since the page was loaded
+    unsigned int age;       // load sequence number, compared wrap-safely
+};
+
 // Frame Table Struct
 struct frame_table {
-    int* time_stamps;
-    int* frames;
-    int* pages;
-    int* permissions;
+    struct frame *frames;   // descriptor for every frame
+    int *free_frames;       // stack of free frame numbers
+    int nfree;
+    int nused;
+    unsigned int clock;     // next load sequence number
 };
 
 /*
@@ -56,26 +167,18 @@ struct frame_table {
  */
 void print_frame_table(){
     int i;
-    printf("Page\t|\tFrame\t|\tData\t|\tPermissions\t|\tTime Stamp Order\t| \n");
+    printf("Page\t|\tFrame\t|\tFlags\t|\tAge\t| \n");
     for (i = 0; i < NFRAMES; i++){
-        printf("%d\t\t%d\t\t%d\t\t%d\t\t\t%d\n",
-               FT.pages[i],
+        printf("%d\t\t%d\t\t%d\t\t%u\n",
+               FT.frames[i].page,
                i,
-               FT.frames[i],
-               FT.permissions[i],
-               FT.time_stamps[i]);
+               FT.frames[i].flags,
+               FT.frames[i].age);
     }
 }
 
 int num_elements_in_frame_table(){
-    int i;
-    int count = 0;
-    for (i = 0; i < NFRAMES; i++){
-        if (FT.frames[i] == 1){
-            count++;
-        }
-    }
-    return count;
+    return FT.nused;
 }
 
 
@@ -88,14 +191,7 @@ int num_elements_in_frame_table(){
  *            False: Frame is not full
  */
 bool frame_is_full(){
-    
-    int mem_count;
-    mem_count = num_elements_in_frame_table();
-    // printf("Mem count is:  %d\n", mem_count);
-    if (mem_count == NFRAMES){
-        return true;
-    }
-    return false;
+    return FT.nused == NFRAMES;
 }
 
 
@@ -110,246 +206,1474 @@ bool frame_is_full(){
  *           False: Frame is not free
  */
 bool is_frame_free(int frame_number){
-    if (FT.frames[frame_number] == 0){
-        return true;
+    return !(FT.frames[frame_number].flags & FRAME_USED);
+}
+
+/*
+ * Function:  frame_is_dirty
+ * --------------------
+ * Determines if the page in a frame must be written back on eviction
+ *
+ *  frame_number: # of frame to query
+ */
+bool frame_is_dirty(int frame_number){
+    return (FT.frames[frame_number].flags & FRAME_DIRTY) != 0;
+}
+
+/*
+ * Function:  frame_is_evictable
+ * --------------------
+ * Determines if a frame holds a page that may be chosen as a victim
+ *
+ *  frame_number: # of frame to query
+ */
+bool frame_is_evictable(int frame_number){
+    return (FT.frames[frame_number].flags & (FRAME_USED|FRAME_PINNED)) == FRAME_USED;
+}
+
+/*
+ * Function:  older_frame
+ * --------------------
+ * Compares load ages so the 32-bit sequence number may wrap
+ *
+ *  returns: True if frame a was loaded before frame b
+ */
+bool older_frame(int a, int b){
+    return (int)(FT.frames[a].age - FT.frames[b].age) < 0;
+}
+
+/*
+ * Function:  frame_table_init
+ * --------------------
+ * Creates the global frame table with every frame free
+ *
+ *  nframes:    number of frames in physical memory
+ */
+void frame_table_init(int nframes){
+    int i;
+    FT.frames = calloc(nframes, sizeof(struct frame));
+    FT.free_frames = malloc(sizeof(int) * nframes);
+    if (!FT.frames || !FT.free_frames){
+        fprintf(stderr,"couldn't create frame table: %s\n",strerror(errno));
+        exit(1);
+    }
+    // Push in reverse so the lowest frame numbers are handed out first
+    FT.nfree = 0;
+    for (i = nframes - 1; i >= 0; i--){
+        FT.free_frames[FT.nfree++] = i;
+    }
+    FT.nused = 0;
+    FT.clock = 0;
+}
+
+/*
+ * Function:  rand_func
+ * --------------------
+ * Picks a random evictable frame.  Drawing among the evictable frames
+ * rather than all of them means a mostly free memory never makes the
+ * caller retry.
+ *
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ *  returns: n:    index of the chosen frame, or -1 if there is none
+ */
+int rand_func(int first, int last){
+    // printf("rand_func:  getting random position \n");
+    int n, count = 0;
+    for (n = first; n < last; n++){
+        count += frame_is_evictable(n);
+    }
+    if (count == 0){
+        return -1;
+    }
+    count = rand() % count;
+    for (n = first; !frame_is_evictable(n) || count-- > 0; n++){
+    }
+    // printf("rand_func:  random number = %d \n", n);
+    return n;
+}
+
+
+/*
+ * Function:  fifo
+ * --------------------
+ * Performs FIFO behavior
+ *
+ *  pt:     pointer to the page table
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ *  returns: first_in:  index of the frame that was
+ *                      loaded longest ago
+ */
+int fifo(struct page_table *pt, int page, int first, int last){
+    
+    // Find the first in frame
+    int each_frame;
+    int first_in_frame = -1;
+    for (each_frame = first; each_frame < last; each_frame++){
+        if (!frame_is_evictable(each_frame)){
+            continue;
+        }
+        if (first_in_frame < 0 || older_frame(each_frame, first_in_frame)){
+            first_in_frame = each_frame;
+        }
+    }
+    return first_in_frame;
+}
+
+/*
+ * Function:  get_initial_frame()
+ * --------------------
+ * Takes a frame off the free stack
+ *
+ * returns: free_frame:  index of new frame number that's free
+ *
+ */
+
+int get_initial_frame(){
+    return FT.free_frames[--FT.nfree];
+}
+
+/*
+ * Function:  end_startup
+ * --------------------
+ * Ends the startup phase at the first eviction, whichever path makes it:
+ * an inline eviction, a watermark reclaim or a frame claimed for a hint
+ *
+ *  faults: faults that were served before the eviction
+ */
+void end_startup(long long faults){
+    if (STARTUP_FAULTS < 0){
+        STARTUP_FAULTS = faults;
+    }
+}
+
+/*
+ * Function:  custom()
+ * --------------------
+ * Searches for a clean entry that can be evicted without writing
+ * anything back to disk.  Returns the fifo frame if it can't
+ * find anything.
+ *
+ *  pt:     pointer to the page table
+ *  page:   page associated with the page fault
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ * returns: clean_frame:  index of frame that's clean
+ *
+ */
+int custom(struct page_table *pt, int page, int first, int last){
+    int clean_frame;
+    for (clean_frame = first; clean_frame < last; clean_frame++){
+        if ((FT.frames[clean_frame].flags & (FRAME_USED|FRAME_DIRTY|FRAME_PINNED)) == FRAME_USED){
+            return clean_frame;
+        }
+    }
+    clean_frame = fifo(pt, page, first, last);
+    return clean_frame;
+}
+
+
+/*
+ * Function:  get_new_frame_num()
+ * --------------------
+ * Determines a new frame number depending on the page
+ * replacement algorithm selected
+ *
+ *  pt:     pointer to the page table
+ *  page:   page associated with the page fault
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ * returns: n:  index of new frame number
+ *
+ */
+int get_new_frame_num(struct page_table *pt, int page, int first, int last){
+    int n = first;
+    if (strcmp(PAGE_REPLACEMENT_TYPE, "rand") == 0){
+        n = rand_func(first, last);
+    }
+    else if (strcmp(PAGE_REPLACEMENT_TYPE, "fifo") == 0){
+        n = fifo(pt, page, first, last);
+    }
+    else if (strcmp(PAGE_REPLACEMENT_TYPE, "custom") == 0){
+        n = custom(pt, page, first, last);
+    }
+    return n;
+}
+
+/*
+ * Function:  region_note_fault
+ * --------------------
+ * Adds a fault to its region's window and reclassifies the region each
+ * time the window fills.  A mostly sequential stream is looping when it
+ * keeps coming back to evicted pages and sequential otherwise.
+ *
+ *  page:   page that faulted
+ */
+void region_note_fault(int page){
+    struct region *r = &REGION_TABLE[page / REGION_PAGES];
+    
+    if (page == r->last_page + 1 || page == r->last_page - 1){
+        r->sequential++;
+    }
+    if (PAGE_EVICTED[page]){
+        r->refaults++;
+    }
+    r->last_page = page;
+    
+    if (++r->faults == REGION_WINDOW){
+        if (r->sequential * 4 < REGION_WINDOW * 3){
+            r->pattern = REGION_RANDOM;
+        }
+        else if (r->refaults * 2 >= REGION_WINDOW){
+            r->pattern = REGION_LOOPING;
+        }
+        else {
+            r->pattern = REGION_SEQUENTIAL;
+        }
+        r->faults = r->sequential = r->refaults = 0;
+    }
+}
+
+/*
+ * Function:  region_victim
+ * --------------------
+ * Picks a victim by region pattern: the oldest page of a sequential
+ * region first, since streamed pages are not reused, then the newest
+ * page of a looping region (MRU keeps the rest of the loop resident).
+ * The REGION_RECENT newest loads are never chosen: an access that spans
+ * pages faults them in one after another, and evicting the page it has
+ * just loaded would make it fault forever
+ *
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ *  returns: index of the frame to evict, or -1 if no resident page
+ *           outside the newest loads belongs to a classified region
+ */
+int region_victim(int first, int last){
+    int frame, pattern;
+    int oldest_seq = -1, newest_loop = -1;
+    for (frame = first; frame < last; frame++){
+        if (!frame_is_evictable(frame) || FT.clock - FT.frames[frame].age <= REGION_RECENT){
+            continue;
+        }
+        pattern = REGION_TABLE[FT.frames[frame].page / REGION_PAGES].pattern;
+        if (pattern == REGION_SEQUENTIAL){
+            if (oldest_seq < 0 || older_frame(frame, oldest_seq)){
+                oldest_seq = frame;
+            }
+        }
+        else if (pattern == REGION_LOOPING){
+            if (newest_loop < 0 || older_frame(newest_loop, frame)){
+                newest_loop = frame;
+            }
+        }
+    }
+    if (oldest_seq >= 0){
+        REGION_SEQ_VICTIMS++;
+        return oldest_seq;
+    }
+    if (newest_loop >= 0){
+        REGION_LOOP_VICTIMS++;
+    }
+    return newest_loop;
+}
+
+/*
+ * Function:  get_evict_frame()
+ * --------------------
+ * Picks a frame to evict.  With regions enabled, region_victim()
+ * chooses first; otherwise, or if it finds no candidate, the selected
+ * policy does.  Every policy only considers frames that are in use and
+ * not pinned, so the choice is made in a single pass.
+ *
+ *  pt:     pointer to the page table
+ *  page:   page associated with the page fault
+ *  first:  first frame that may be chosen
+ *  last:   one past the last frame that may be chosen
+ *
+ * returns: n:  index of the frame to evict, or -1 if every frame
+ *              in the range is free or pinned
+ *
+ */
+int get_evict_frame(struct page_table *pt, int page, int first, int last){
+    int frame_to_evict;
+    if (NUM_REGIONS){
+        frame_to_evict = region_victim(first, last);
+        if (frame_to_evict >= 0){
+            return frame_to_evict;
+        }
+    }
+    return get_new_frame_num(pt, page, first, last);
+}
+
+/*
+ * Function:  use_frame()
+ * --------------------
+ * Records that a frame now holds a page
+ *
+ *  frame:  frame being filled
+ *  page:   page loaded into the frame
+ *  flags:  FRAME_* bits for the new contents
+ */
+void use_frame(int frame, int page, int flags){
+    FT.frames[frame].page = page;
+    FT.frames[frame].flags = flags | FRAME_USED;
+    FT.frames[frame].age = FT.clock++;
+    FT.nused++;
+}
+
+/*
+ * Function:  evict_frame()
+ * --------------------
+ * Actually evict the frame
+ *
+ *  frame_to_evict:     Frame number to evict
+ *
+ */
+void evict_frame(int frame_to_evict){
+    // printf("Evicting frame %d ... \n", frame_to_evict);
+    FT.frames[frame_to_evict].page = 0;
+    FT.frames[frame_to_evict].flags = 0;
+    FT.frames[frame_to_evict].age = 0;
+    FT.nused--;
+}
+
+/*
+ * Function:  release_frame()
+ * --------------------
+ * Evicts a frame and puts it back on the free stack
+ *
+ *  frame:  frame to release
+ */
+void release_frame(int frame){
+    evict_frame(frame);
+    FT.free_frames[FT.nfree++] = frame;
+}
+
+/*
+ * Function:  frame_data
+ * --------------------
+ * Returns the start of a frame in physical memory, computing the
+ * offset in 64 bits so large memories do not overflow
+ */
+char *frame_data(int frame){
+    return &PHYSMEM[(size_t)frame * FRAME_SIZE];
+}
+
+/*
+ * Function:  sector_hash
+ * --------------------
+ * Hashes one DISK_SECTOR_SIZE sector.  Four independent 64-bit lanes
+ * are mixed so the loop has no serial dependency and the compiler can
+ * keep it in vector registers.  Every step is invertible, so a change
+ * confined to one lane always changes that lane; each lane is then
+ * finalized and the lanes are combined with rotates, which keep all of
+ * their bits.
+ *
+ *  data:   start of the sector
+ *
+ *  returns: 64-bit hash of the sector contents
+ */
+static inline unsigned long long fmix64(unsigned long long h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline unsigned long long rotl64(unsigned long long h, int r){
+    return (h << r) | (h >> (64 - r));
+}
+
+unsigned long long sector_hash(const char *data){
+    const unsigned long long *w = (const unsigned long long *)data;
+    unsigned long long h0 = 0x9E3779B97F4A7C15ULL, h1 = 0xC2B2AE3D27D4EB4FULL;
+    unsigned long long h2 = 0x165667B19E3779F9ULL, h3 = 0x27D4EB2F165667C5ULL;
+    int i;
+    for (i = 0; i < DISK_SECTOR_SIZE / 8; i += 4){
+        h0 = (h0 ^ w[i])   * 0xff51afd7ed558ccdULL;
+        h1 = (h1 ^ w[i+1]) * 0xff51afd7ed558ccdULL;
+        h2 = (h2 ^ w[i+2]) * 0xff51afd7ed558ccdULL;
+        h3 = (h3 ^ w[i+3]) * 0xff51afd7ed558ccdULL;
+    }
+    return fmix64(h0) ^ rotl64(fmix64(h1), 16) ^ rotl64(fmix64(h2), 32) ^ rotl64(fmix64(h3), 48);
+}
+
+/*
+ * Function:  record_sector_sums
+ * --------------------
+ * Remembers the per-sector hashes of a frame as it was loaded
+ *
+ *  frame:  frame that was just read from disk
+ */
+void record_sector_sums(int frame){
+    int i;
+    for (i = 0; i < DISK_SECTORS_PER_BLOCK; i++){
+        SECTOR_SUMS[(size_t)frame*DISK_SECTORS_PER_BLOCK + i] =
+            sector_hash(frame_data(frame) + i*DISK_SECTOR_SIZE);
+    }
+}
+
+/*
+ * Function:  forget_sector_sums
+ * --------------------
+ * Makes every sector of a frame compare as changed, for a frame whose
+ * contents never came from its disk block
+ *
+ *  frame:  frame to mark
+ */
+void forget_sector_sums(int frame){
+    int i;
+    for (i = 0; i < DISK_SECTORS_PER_BLOCK; i++){
+        SECTOR_SUMS[(size_t)frame*DISK_SECTORS_PER_BLOCK + i] =
+            ~sector_hash(frame_data(frame) + i*DISK_SECTOR_SIZE);
+    }
+}
+
+/*
+ * Function:  dirty_sector_mask
+ * --------------------
+ * Finds the sectors of a frame that changed since it was loaded
+ *
+ *  frame:  frame being written back
+ *
+ *  returns: mask with bit i set if sector i changed
+ */
+unsigned dirty_sector_mask(int frame){
+    unsigned mask = 0;
+    int i;
+    for (i = 0; i < DISK_SECTORS_PER_BLOCK; i++){
+        if (sector_hash(frame_data(frame) + i*DISK_SECTOR_SIZE) !=
+            SECTOR_SUMS[(size_t)frame*DISK_SECTORS_PER_BLOCK + i]){
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/*
+ * Function:  check_sector_hash
+ * --------------------
+ * Self-check for delta write-back, run by delta=check: flips every bit
+ * of a frame in turn and makes sure dirty_sector_mask reports exactly
+ * that sector.  A hash that misses a change would silently lose data.
+ *
+ *  frame:  free frame to use as scratch space
+ *
+ *  returns: 0 if every flip is caught, -1 otherwise
+ */
+int check_sector_hash(int frame){
+    unsigned char *data = (unsigned char *)frame_data(frame);
+    int bit, failed = 0;
+    
+    memset(data, 0, FRAME_SIZE);
+    record_sector_sums(frame);
+    for (bit = 0; bit < FRAME_SIZE * 8 && !failed; bit++){
+        data[bit / 8] ^= 1 << (bit % 8);
+        if (dirty_sector_mask(frame) != 1u << (bit / 8 / DISK_SECTOR_SIZE)){
+            fprintf(stderr,"delta: flipping bit %d of a frame is not detected\n", bit);
+            failed = 1;
+        }
+        data[bit / 8] ^= 1 << (bit % 8);
+    }
+    return failed ? -1 : 0;
+}
+
+/*
+ * Function:  load_frame
+ * --------------------
+ * Reads a page from disk into a frame
+ *
+ *  frame:  destination frame
+ *  page:   page (disk block) to read
+ */
+void load_frame(int frame, int page){
+    if (PAGE_HINTS && (PAGE_HINTS[page] & PAGE_HINT_ZERO)){
+        // The page is about to be overwritten or was discarded, so nothing on disk is needed
+        PAGE_HINTS[page] &= ~PAGE_HINT_ZERO;
+        memset(frame_data(frame), 0, FRAME_SIZE);
+        if (DELTA_WRITEBACK){
+            forget_sector_sums(frame);
+        }
+        HINT_SKIPPED_READS++;
+        return;
+    }
+    NUM_DISK_READS++;
+    if (ZERO_COPY){
+        // The page is a window onto the disk file; mapping it is the read
+        disk_charge_block(DISK, page, 0);
+        return;
+    }
+    disk_read(DISK, page, frame_data(frame));
+    NUM_BYTES_COPIED += BLOCK_SIZE;
+    if (DELTA_WRITEBACK){
+        record_sector_sums(frame);
+    }
+}
+
+/*
+ * Function:  write_back_frame
+ * --------------------
+ * Writes a dirty frame back to its disk block.  With delta write-back
+ * only the sectors that changed since the frame was loaded are written.
+ *
+ *  frame:  frame holding the dirty page
+ *  page:   page (disk block) the frame belongs to
+ */
+void write_back_frame(int frame, int page){
+    if (ZERO_COPY){
+        // Start write-back of just this block straight from the page cache
+        sync_file_range(disk_fd(DISK), (off_t)page * BLOCK_SIZE, BLOCK_SIZE, SYNC_FILE_RANGE_WRITE);
+        disk_charge_block(DISK, page, 1);
+        NUM_BYTES_WRITTEN += BLOCK_SIZE;
+        NUM_DISK_WRITES++;
+        return;
+    }
+    if (DELTA_WRITEBACK){
+        unsigned mask = dirty_sector_mask(frame);
+        if (mask == 0){
+            return;
+        }
+        int written = disk_write_sectors(DISK, page, frame_data(frame), mask);
+        NUM_BYTES_WRITTEN += written;
+        NUM_BYTES_COPIED += written;
     }
     else {
+        disk_write(DISK, page, frame_data(frame));
+        NUM_BYTES_WRITTEN += BLOCK_SIZE;
+        NUM_BYTES_COPIED += BLOCK_SIZE;
+    }
+    NUM_DISK_WRITES++;
+}
+
+/*
+ * Function:  migrate_frame
+ * --------------------
+ * Moves a resident page from one frame to a free one without touching
+ * the disk, keeping its flags, age and sector sums
+ *
+ *  pt:     pointer to the page table
+ *  from:   frame holding the page, free afterwards
+ *  to:     free frame that receives the page
+ */
+void migrate_frame(struct page_table *pt, int from, int to){
+    struct frame moved = FT.frames[from];
+    int bits = (moved.flags & FRAME_DIRTY) ? PROT_READ|PROT_WRITE : PROT_READ;
+    
+    memcpy(frame_data(to), frame_data(from), FRAME_SIZE);
+    if (DELTA_WRITEBACK){
+        memcpy(&SECTOR_SUMS[(size_t)to*DISK_SECTORS_PER_BLOCK],
+               &SECTOR_SUMS[(size_t)from*DISK_SECTORS_PER_BLOCK],
+               DISK_SECTORS_PER_BLOCK * sizeof(unsigned long long));
+    }
+    moved.flags &= ~FRAME_SAMPLED;
+    moved.refs = 0;
+    FT.frames[to] = moved;
+    FT.nused++;
+    evict_frame(from);
+    page_table_set_entry(pt, moved.page, to, bits);
+}
+
+/*
+ * Function:  demote_fast_frame
+ * --------------------
+ * Makes room in the fast tier by moving its coldest page into a free
+ * slow frame
+ *
+ *  pt:     pointer to the page table
+ *  page:   page associated with the page fault
+ *  slow:   free slow frame that receives the demoted page
+ *
+ *  returns: the fast frame that is now free
+ */
+int demote_fast_frame(struct page_table *pt, int page, int slow){
+    int fast = get_evict_frame(pt, page, 0, TIER_FAST_FRAMES);
+    migrate_frame(pt, fast, slow);
+    TIER_DEMOTIONS++;
+    return fast;
+}
+
+/*
+ * Function:  promote_slow_frame
+ * --------------------
+ * Swaps a hot slow-tier page with the coldest fast-tier page
+ *
+ *  pt:     pointer to the page table
+ *  slow:   slow frame holding the hot page
+ */
+void promote_slow_frame(struct page_table *pt, int slow){
+    static char buffer[FRAME_SIZE];
+    static unsigned long long sums[DISK_SECTORS_PER_BLOCK];
+    struct frame hot = FT.frames[slow];
+    int fast, hot_bits;
+    
+    // Park the hot page, demote a fast page into its frame, then
+    // move the hot page into the fast frame that was freed
+    memcpy(buffer, frame_data(slow), FRAME_SIZE);
+    if (DELTA_WRITEBACK){
+        memcpy(sums, &SECTOR_SUMS[(size_t)slow*DISK_SECTORS_PER_BLOCK], sizeof(sums));
+    }
+    evict_frame(slow);
+    fast = demote_fast_frame(pt, hot.page, slow);
+    
+    memcpy(frame_data(fast), buffer, FRAME_SIZE);
+    if (DELTA_WRITEBACK){
+        memcpy(&SECTOR_SUMS[(size_t)fast*DISK_SECTORS_PER_BLOCK], sums, sizeof(sums));
+    }
+    hot.flags &= ~FRAME_SAMPLED;
+    hot.refs = 0;
+    hot.age = FT.clock++;
+    FT.frames[fast] = hot;
+    FT.nused++;
+    hot_bits = (hot.flags & FRAME_DIRTY) ? PROT_READ|PROT_WRITE : PROT_READ;
+    page_table_set_entry(pt, hot.page, fast, hot_bits);
+    TIER_PROMOTIONS++;
+}
+
+/*
+ * Function:  sample_references
+ * --------------------
+ * Unmaps a few random resident pages so that their next reference
+ * faults and can be charged to the tier the page lives in
+ *
+ *  pt:     pointer to the page table
+ *  page:   page being handled, which is never sampled
+ */
+void sample_references(struct page_table *pt, int page){
+    int samples = NFRAMES / 16 + 1;
+    int i, frame;
+    for (i = 0; i < samples; i++){
+        frame = rand_r(&TIER_SEED) % NFRAMES;
+        if (is_frame_free(frame) || FT.frames[frame].page == page ||
+            (FT.frames[frame].flags & FRAME_SAMPLED)){
+            continue;
+        }
+        FT.frames[frame].flags |= FRAME_SAMPLED;
+        page_table_set_entry(pt, FT.frames[frame].page, frame, 0);
+    }
+}
+
+/*
+ * Function:  sampled_reference
+ * --------------------
+ * Checks whether a fault was caused by reference sampling; if so the
+ * page is mapped again, the hit is counted against its tier and hot
+ * slow pages are promoted
+ *
+ *  pt:     pointer to the page table
+ *  page:   page number that is faulty
+ *
+ *  returns: true if the fault was a sampled reference
+ */
+bool sampled_reference(struct page_table *pt, int page){
+    int fn, bits;
+    page_table_get_entry(pt, page, &fn, &bits);
+    if (bits != 0 || fn < 0 || fn >= NFRAMES || is_frame_free(fn) ||
+        FT.frames[fn].page != page || !(FT.frames[fn].flags & FRAME_SAMPLED)){
         return false;
     }
+    
+    TIER_SAMPLE_FAULTS++;
+    FT.frames[fn].flags &= ~FRAME_SAMPLED;
+    page_table_set_entry(pt, page, fn, frame_is_dirty(fn) ? PROT_READ|PROT_WRITE : PROT_READ);
+    if (fn < TIER_FAST_FRAMES){
+        TIER_FAST_HITS++;
+    }
+    else {
+        TIER_SLOW_HITS++;
+        if (++FT.frames[fn].refs >= TIER_PROMOTE_REFS){
+            promote_slow_frame(pt, fn);
+        }
+    }
+    return true;
+}
+
+int compare_frame_page(const void *a, const void *b){
+    return FT.frames[*(const int *)a].page - FT.frames[*(const int *)b].page;
 }
+
 /*
- * Function:  update_frame
+ * Function:  reclaim_frames
  * --------------------
- * Inserts a new frame into the frame table; updates the value
- * in the grame table to be one to indicate that it's inserted
- * Also updates the time stamps table
+ * Evicts a batch of victims in one pass until "target" frames are free.
+ * Dirty victims are written back in block order.
  *
- *  frame:      index of frame to insert
- *  p:          permissions of frame being inserted
+ *  pt:     pointer to the page table
+ *  target: number of free frames wanted
+ *
+ *  returns: number of frames reclaimed
  */
-void update_frame(int frame, int p, int p_n){
-    // printf("(A) updating new frame table:....................\n");
-    // print_frame_table();
+int reclaim_frames(struct page_table *pt, int target){
+    static int *victims;
+    static int capacity;
+    int count = 0, i, frame;
     
-    /*printf("updating........................................\n");
-    printf("frame_num:.................................... %d\n", frame);
-    printf("page_num:..................................... %d\n", p_n);
-    printf("permissions:.................................. %d\n", p);*/
+    if (capacity < NFRAMES){
+        free(victims);
+        victims = malloc(sizeof(int) * NFRAMES);
+        capacity = NFRAMES;
+    }
     
-    FT.time_stamps[TIME_STAMP_SIZE] = frame;
-    TIME_STAMP_SIZE++;
-    FT.frames[frame] = 1;
+    // Pin each victim as it is chosen so the policy moves on to the next
+    while (FT.nfree + count < target){
+        frame = get_evict_frame(pt, -1, TIER_FAST_FRAMES, NFRAMES);
+        if (frame < 0){
+            break;
+        }
+        end_startup(NUM_PAGE_FAULTS);
+        FT.frames[frame].flags |= FRAME_PINNED;
+        victims[count++] = frame;
+    }
     
-    // printf("(B) after `FT.frames[frame] = 1` :....................\n");
-    // print_frame_table();
+    qsort(victims, count, sizeof(int), compare_frame_page);
+    for (i = 0; i < count; i++){
+        frame = victims[i];
+        page_table_set_entry(pt, FT.frames[frame].page, 0, 0);
+        if (PAGE_EVICTED){
+            PAGE_EVICTED[FT.frames[frame].page] = 1;
+        }
+        if (frame_is_dirty(frame)){
+            write_back_frame(frame, FT.frames[frame].page);
+        }
+        release_frame(frame);
+    }
     
-    FT.permissions[frame] = p;
-    // printf("(C) after `FT.permissions[frame] = p;` :....................\n");
-    // print_frame_table();
+    if (count){
+        RECLAIM_BATCHES++;
+        RECLAIM_FRAMES += count;
+    }
+    return count;
+}
+
+/*
+ * Function:  reclaim_if_low
+ * --------------------
+ * Refills the free pool up to the high watermark once it falls below
+ * the low watermark, so later faults find a free frame
+ *
+ *  pt:     pointer to the page table
+ *  page:   page that was just mapped, kept out of the batch
+ */
+void reclaim_if_low(struct page_table *pt, int page){
+    int fn, bits, pinned;
+    if (RECLAIM_LOW == 0 || FT.nfree >= RECLAIM_LOW){
+        return;
+    }
+    page_table_get_entry(pt, page, &fn, &bits);
+    pinned = FT.frames[fn].flags & FRAME_PINNED;
+    FT.frames[fn].flags |= FRAME_PINNED;
+    reclaim_frames(pt, RECLAIM_HIGH);
+    FT.frames[fn].flags = (FT.frames[fn].flags & ~FRAME_PINNED) | pinned;
+}
+
+/*
+ * Function:  pin_limit
+ * --------------------
+ * Returns how many frames advice may pin.  A quarter of memory, at
+ * least two readahead windows and the high watermark stay unpinned so
+ * faults, readahead and reclaim always find a victim.
+ */
+int pin_limit(){
+    int reserve = NFRAMES / 4;
+    if (reserve < 2 * READAHEAD_PAGES){
+        reserve = 2 * READAHEAD_PAGES;
+    }
+    if (reserve <= RECLAIM_HIGH){
+        reserve = RECLAIM_HIGH + 1;
+    }
+    return NFRAMES > reserve ? NFRAMES - reserve : 0;
+}
+
+/*
+ * Function:  pin_frame
+ * --------------------
+ * Pins a frame on behalf of advice, while the pin limit allows
+ *
+ *  frame:  frame holding a page with PAGE_HINT_PIN
+ */
+void pin_frame(int frame){
+    if (!(FT.frames[frame].flags & FRAME_PINNED) && NUM_PINNED_FRAMES < pin_limit()){
+        FT.frames[frame].flags |= FRAME_PINNED;
+        NUM_PINNED_FRAMES++;
+    }
+}
+
+/*
+ * Function:  claim_frame
+ * --------------------
+ * Finds a frame for a page that nobody is faulting on yet: a free
+ * frame, or else a victim from the selected policy, written back and
+ * unmapped
+ *
+ *  pt:     pointer to the page table
+ *
+ *  returns: a frame that is now free, or -1 if every frame is pinned
+ */
+int claim_frame(struct page_table *pt){
+    int frame, victim;
+    if (FT.nfree > 0){
+        return get_initial_frame();
+    }
+    frame = get_evict_frame(pt, -1, TIER_FAST_FRAMES, NFRAMES);
+    if (frame < 0){
+        return -1;
+    }
+    end_startup(NUM_PAGE_FAULTS);
+    victim = FT.frames[frame].page;
+    page_table_set_entry(pt, victim, 0, 0);
+    if (PAGE_EVICTED){
+        PAGE_EVICTED[victim] = 1;
+    }
+    if (frame_is_dirty(frame)){
+        write_back_frame(frame, victim);
+    }
+    evict_frame(frame);
+    return frame;
+}
+
+/*
+ * Function:  prefetch_pages
+ * --------------------
+ * Reads the pages of a range that are not resident with one batched
+ * read, so neighbouring blocks merge and a striped disk fetches them in
+ * parallel.  Pages with dead contents are left to zero-fill on their
+ * fault, and at most half of the unpinned frames are used.
+ *
+ *  pt:     pointer to the page table
+ *  first:  first page of the range
+ *  count:  number of pages in the range
+ *
+ *  returns: number of pages read in
+ */
+int prefetch_pages(struct page_table *pt, int first, int count){
+    static int *blocks, *frames;
+    static char **data;
+    static int capacity;
+    int limit = (NFRAMES - NUM_PINNED_FRAMES) / 2;
+    int n = 0, i, page, frame, fn, bits;
     
-    FT.pages[frame] = p_n;
-    // printf("(D) after `FT.pages[frame] = p_n;` :....................\n");
-    // print_frame_table();
+    if (capacity < NFRAMES){
+        free(blocks);
+        free(frames);
+        free(data);
+        blocks = malloc(sizeof(int) * NFRAMES);
+        frames = malloc(sizeof(int) * NFRAMES);
+        data = malloc(sizeof(char *) * NFRAMES);
+        capacity = NFRAMES;
+    }
     
-    // printf("(E) updating new frame table:....................\n");
-    // print_frame_table();
+    // Frames are pinned while the batch is gathered so it never evicts itself
+    for (page = first; page < first + count && n < limit; page++){
+        page_table_get_entry(pt, page, &fn, &bits);
+        if (bits != 0 || (PAGE_HINTS[page] & PAGE_HINT_ZERO)){
+            continue;
+        }
+        frame = claim_frame(pt);
+        if (frame < 0){
+            break;
+        }
+        use_frame(frame, page, FRAME_PINNED);
+        blocks[n] = page;
+        frames[n] = frame;
+        data[n] = frame_data(frame);
+        n++;
+    }
+    
+    disk_read_batch(DISK, blocks, data, n);
+    NUM_DISK_READS += n;
+    NUM_BYTES_COPIED += (long long)n * BLOCK_SIZE;
+    
+    for (i = 0; i < n; i++){
+        FT.frames[frames[i]].flags &= ~FRAME_PINNED;
+        if (DELTA_WRITEBACK){
+            record_sector_sums(frames[i]);
+        }
+        page_table_set_entry(pt, blocks[i], frames[i], PROT_READ);
+        if (PAGE_HINTS[blocks[i]] & PAGE_HINT_PIN){
+            pin_frame(frames[i]);
+        }
+    }
+    return n;
 }
 
 /*
- * Function:  handle_fifo_table
+ * Function:  drop_page
  * --------------------
- * When evicting a page from the frame, this updates the time
- * stamp entry of that page to be -1.
+ * Unmaps a resident page and frees its frame
  *
- *  frame:      index of frame to evict
+ *  pt:         pointer to the page table
+ *  page:       page to drop
+ *  frame:      frame holding the page
+ *  write_back: whether a dirty page is written back first
  */
-void handle_fifo_table(int frame){
-    int i;
-    for (i = 0; i < TIME_STAMP_SIZE; i++){
-        if (FT.time_stamps[i] == frame){
-            FT.time_stamps[i] = -1;
+void drop_page(struct page_table *pt, int page, int frame, bool write_back){
+    page_table_set_entry(pt, page, 0, 0);
+    if (write_back && frame_is_dirty(frame)){
+        write_back_frame(frame, page);
+    }
+    if (FT.frames[frame].flags & FRAME_PINNED){
+        NUM_PINNED_FRAMES--;
+    }
+    release_frame(frame);
+}
+
+/*
+ * Function:  follow_hints
+ * --------------------
+ * Applies a page's advice once a fault has loaded it: its frame is
+ * pinned if the page is, and a fault in a sequential range drops the
+ * pages a window behind it and reads the next window ahead
+ *
+ *  pt:     pointer to the page table
+ *  page:   page that was just loaded
+ *  frame:  frame holding the page
+ */
+void follow_hints(struct page_table *pt, int page, int frame){
+    int q, count, fn, bits, pinned;
+    
+    if (PAGE_HINTS[page] & PAGE_HINT_PIN){
+        pin_frame(frame);
+    }
+    if (!(PAGE_HINTS[page] & PAGE_HINT_SEQUENTIAL)){
+        return;
+    }
+    
+    for (q = page - 2 * READAHEAD_PAGES; q < page - READAHEAD_PAGES; q++){
+        if (q < 0 || !(PAGE_HINTS[q] & PAGE_HINT_SEQUENTIAL)){
+            continue;
+        }
+        page_table_get_entry(pt, q, &fn, &bits);
+        if (bits != 0 && !(FT.frames[fn].flags & FRAME_PINNED)){
+            drop_page(pt, q, fn, true);
+            HINT_DROP_BEHIND++;
+        }
+    }
+    
+    for (count = 0; count < READAHEAD_PAGES && page + 1 + count < NPAGES; count++){
+        if (!(PAGE_HINTS[page + 1 + count] & PAGE_HINT_SEQUENTIAL)){
             break;
         }
     }
+    pinned = FT.frames[frame].flags & FRAME_PINNED;
+    FT.frames[frame].flags |= FRAME_PINNED;
+    HINT_READAHEAD_PAGES += prefetch_pages(pt, page + 1, count);
+    FT.frames[frame].flags = (FT.frames[frame].flags & ~FRAME_PINNED) | pinned;
 }
 
 /*
- * Function:  rand_func
+ * Function:  advise_pages
  * --------------------
- * Finds random position in physical memory
+ * Advice handler registered with the page table.  Hints are recorded
+ * per page and honoured by the fault handler; WILLNEED, DONTNEED and
+ * the pins of resident pages take effect at once.  The trivial mapping
+ * zero-copy paging and tiers, whose sampling unmaps resident pages,
+ * ignore advice.
  *
- *  returns: n:    page number of memory with free frame
+ *  pt:     pointer to the page table
+ *  first:  first page of the range
+ *  count:  number of pages in the range
+ *  advice: PAGE_ADVICE_* value
  */
-int rand_func(){
-    // printf("rand_func:  getting random position \n");
-    int n;
-    n = rand() % NFRAMES;
-    // printf("rand_func:  random number = %d \n", n);
-    return n;
+void advise_pages(struct page_table *pt, int first, int count, int advice){
+    int page, fn, bits;
+    
+    if (NFRAMES == NPAGES || ZERO_COPY || TIER_FAST_FRAMES){
+        return;
+    }
+    if (!PAGE_HINTS){
+        PAGE_HINTS = calloc(NPAGES, 1);
+        if (!PAGE_HINTS){
+            return;
+        }
+    }
+    
+    if (advice == PAGE_ADVICE_WILLNEED){
+        HINT_PREFETCHED += prefetch_pages(pt, first, count);
+        return;
+    }
+    
+    for (page = first; page < first + count; page++){
+        page_table_get_entry(pt, page, &fn, &bits);
+        switch (advice){
+        case PAGE_ADVICE_NORMAL:
+            PAGE_HINTS[page] &= ~PAGE_HINT_SEQUENTIAL;
+            break;
+        case PAGE_ADVICE_SEQUENTIAL:
+            PAGE_HINTS[page] |= PAGE_HINT_SEQUENTIAL;
+            break;
+        case PAGE_ADVICE_DONTNEED:
+            // Dropped without write-back; the next touch sees zeros
+            if (bits != 0){
+                drop_page(pt, page, fn, false);
+                HINT_DROPPED++;
+            }
+            PAGE_HINTS[page] |= PAGE_HINT_ZERO;
+            break;
+        case PAGE_ADVICE_NOREAD:
+            if (bits == 0){
+                PAGE_HINTS[page] |= PAGE_HINT_ZERO;
+            }
+            break;
+        case PAGE_ADVICE_PIN:
+            PAGE_HINTS[page] |= PAGE_HINT_PIN;
+            if (bits != 0){
+                pin_frame(fn);
+            }
+            break;
+        case PAGE_ADVICE_UNPIN:
+            PAGE_HINTS[page] &= ~PAGE_HINT_PIN;
+            if (bits != 0 && (FT.frames[fn].flags & FRAME_PINNED)){
+                FT.frames[fn].flags &= ~FRAME_PINNED;
+                NUM_PINNED_FRAMES--;
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * Warm start snapshot file layout: a header followed by "count" page
+ * numbers ordered from least to most recently loaded.
+ */
+#define WARM_START_MAGIC 0x53574d56 // "VMWS"
+
+struct warm_start_header {
+    int magic;
+    int npages;
+    int nframes;
+    int count;
+};
+
+int compare_ints(const void *a, const void *b){
+    return *(const int *)a - *(const int *)b;
+}
+
+int compare_frame_age(const void *a, const void *b){
+    int fa = *(const int *)a, fb = *(const int *)b;
+    return older_frame(fa, fb) ? -1 : (older_frame(fb, fa) ? 1 : 0);
+}
+
+/*
+ * Function:  save_warm_start
+ * --------------------
+ * Writes every dirty resident page back to disk and records the resident
+ * set, oldest first, so the next run can prefetch it
+ *
+ *  path:   snapshot file to write
+ *
+ *  returns: 0 on success, -1 on failure
+ */
+int save_warm_start(const char *path){
+    struct warm_start_header header;
+    int *order = malloc(sizeof(int) * NFRAMES);
+    int i, count = 0;
+    long long writes = NUM_DISK_WRITES, bytes = NUM_BYTES_WRITTEN, copied = NUM_BYTES_COPIED;
+    FILE *file;
+    
+    if (!order){
+        return -1;
+    }
+    
+    for (i = 0; i < NFRAMES; i++){
+        if (!is_frame_free(i)){
+            if (frame_is_dirty(i)){
+                write_back_frame(i, FT.frames[i].page);
+                FT.frames[i].flags &= ~FRAME_DIRTY;
+            }
+            order[count++] = i;
+        }
+    }
+    
+    // The snapshot's write-back is reported on its own, not as the program's I/O
+    WARM_START_WRITES = NUM_DISK_WRITES - writes;
+    NUM_DISK_WRITES = writes;
+    NUM_BYTES_WRITTEN = bytes;
+    NUM_BYTES_COPIED = copied;
+    
+    // Oldest first, then swap frame numbers for the pages they hold
+    qsort(order, count, sizeof(int), compare_frame_age);
+    for (i = 0; i < count; i++){
+        order[i] = FT.frames[order[i]].page;
+    }
+    
+    file = fopen(path, "wb");
+    if (!file){
+        free(order);
+        return -1;
+    }
+    header.magic = WARM_START_MAGIC;
+    header.npages = NPAGES;
+    header.nframes = NFRAMES;
+    header.count = count;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(order, sizeof(int), count, file);
+    fclose(file);
+    free(order);
+    return 0;
 }
 
-
 /*
- * Function:  fifo
+ * Function:  restore_warm_start
  * --------------------
- * Performs FIFO behavior
+ * Prefetches the resident set recorded by save_warm_start with batched
+ * vectored reads and maps it read-only, so clean evictions stay free.
+ * A snapshot with more pages than the frames it was taken with, a page
+ * outside the virtual memory or a page listed twice is ignored with a
+ * warning, and the run starts cold.
  *
- *  pt:  pointer to the page table
+ *  pt:     pointer to the page table
+ *  path:   snapshot file to read
  *
- *  returns: first_in:  index of page that was
- *                      removed
+ *  returns: number of pages restored (0 if there is no usable snapshot)
  */
-int fifo(struct page_table *pt, int page){
+int restore_warm_start(struct page_table *pt, const char *path){
+    struct warm_start_header header;
+    int *order, *blocks, *rank, *frames;
+    char **data;
+    int i, first, count;
+    FILE *file = fopen(path, "rb");
     
-    // Find the first in frame
-    int each_frame;
-    int first_in_frame;
-    for (each_frame = 0; each_frame < NFRAMES; each_frame++){
-        if (FT.time_stamps[each_frame] == 0){
-            first_in_frame = each_frame;
+    if (!file){
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != WARM_START_MAGIC || header.npages != NPAGES ||
+        header.nframes <= 0 || header.nframes > NPAGES ||
+        header.count < 0 || header.count > header.nframes){
+        fprintf(stderr,"warmstart: ignoring snapshot %s with a bad header; starting cold\n",path);
+        fclose(file);
+        return 0;
+    }
+    order = malloc(sizeof(int) * (header.count + 1));
+    if (!order){
+        fprintf(stderr,"warmstart: out of memory reading snapshot %s; starting cold\n",path);
+        fclose(file);
+        return 0;
+    }
+    if (fread(order, sizeof(int), header.count, file) != (size_t)header.count){
+        fprintf(stderr,"warmstart: snapshot %s is truncated; starting cold\n",path);
+        free(order);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    
+    // Every listed page must be a distinct page of this virtual memory
+    rank = malloc(sizeof(int) * NPAGES);
+    if (!rank){
+        fprintf(stderr,"warmstart: out of memory reading snapshot %s; starting cold\n",path);
+        free(order);
+        return 0;
+    }
+    for (i = 0; i < NPAGES; i++){
+        rank[i] = -1;
+    }
+    for (i = 0; i < header.count; i++){
+        if (order[i] < 0 || order[i] >= NPAGES || rank[order[i]] >= 0){
+            fprintf(stderr,"warmstart: snapshot %s lists an invalid or repeated page; starting cold\n",path);
+            free(order);
+            free(rank);
+            return 0;
         }
+        rank[order[i]] = i;
     }
     
-    // Update the other frames to now be one less
-    int current_time;
-    int new_time;
-    for (each_frame = 0; each_frame < NFRAMES; each_frame++){
-        current_time = FT.time_stamps[each_frame];
-        new_time = current_time - 1;
-        FT.time_stamps[each_frame] = new_time;
+    // Keep the most recent pages if memory shrank since the snapshot
+    count = header.count < NFRAMES ? header.count : NFRAMES;
+    first = header.count - count;
+    
+    // Recency rank of every restored page, indexed by page number
+    blocks = malloc(sizeof(int) * (count + 1));
+    frames = malloc(sizeof(int) * (count + 1));
+    data = malloc(sizeof(char *) * (count + 1));
+    if (!blocks || !frames || !data){
+        fprintf(stderr,"warmstart: out of memory reading snapshot %s; starting cold\n",path);
+        free(order);
+        free(rank);
+        free(blocks);
+        free(frames);
+        free(data);
+        return 0;
     }
-    return first_in_frame;
+    for (i = 0; i < count; i++){
+        blocks[i] = order[first + i];
+        rank[blocks[i]] = i;
+    }
+    
+    // Read in block order so neighbouring pages merge into one vectored read
+    qsort(blocks, count, sizeof(int), compare_ints);
+    for (i = 0; i < count; i++){
+        frames[i] = get_initial_frame();
+        data[i] = frame_data(frames[i]);
+    }
+    disk_read_batch(DISK, blocks, data, count);
+    NUM_DISK_READS += count;
+    
+    for (i = 0; i < count; i++){
+        page_table_set_entry(pt, blocks[i], frames[i], PROT_READ);
+        use_frame(frames[i], blocks[i], 0);
+        FT.frames[frames[i]].age = rank[blocks[i]];
+        if (DELTA_WRITEBACK){
+            record_sector_sums(frames[i]);
+        }
+    }
+    FT.clock = count;
+    
+    free(order);
+    free(rank);
+    free(blocks);
+    free(frames);
+    free(data);
+    return count;
 }
 
 /*
- * Function:  get_initial_frame()
+ * Function:  publish_stats
  * --------------------
- * Uses a linear search to find new number
- *
- * returns: free_frame:  index of new frame number that's free
+ * Copies the counters into the shared stats segment under its seqlock.
+ * CLOCK_MONOTONIC_COARSE is served by the vDSO, so publishing makes no
+ * system call; the dirty ratio is recounted once per second.
  *
+ *  new_faults: faults to add to the current one-second bucket
  */
-
-int get_initial_frame(){
-    int index = 0;
-    int free_frame = FT.frames[index];
-    while (free_frame == 1){
-        index++;
-        free_frame = FT.frames[index];
+void publish_stats(int new_faults){
+    struct timespec now;
+    long long sec;
+    int i, dirty;
+    
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    sec = now.tv_sec;
+    i = sec % STATS_WINDOW;
+    
+    stats_write_begin(STATS);
+    STATS->page_faults = NUM_PAGE_FAULTS;
+    STATS->disk_reads = NUM_DISK_READS;
+    STATS->disk_writes = NUM_DISK_WRITES;
+    STATS->bytes_written = NUM_BYTES_WRITTEN;
+    STATS->frames_used = FT.nused;
+    if (STATS->bucket_sec[i] != sec){
+        STATS->bucket_sec[i] = sec;
+        STATS->bucket_faults[i] = 0;
+        for (dirty = 0, i = 0; i < NFRAMES; i++){
+            dirty += frame_is_dirty(i);
+        }
+        STATS->frames_dirty = dirty;
+        i = sec % STATS_WINDOW;
     }
-    return index;
+    STATS->bucket_faults[i] += new_faults;
+    stats_write_end(STATS);
 }
 
 /*
- * Function:  custom()
+ * Function:  init_stats
  * --------------------
- * Searches for a clean entry that can be evicted without writing
- * anything back to disk.  Returns the fifo frame if it can't
- * find anything.
- *
- *  pt:     pointer to the page table
- *  page:   page associated with the page fault
- *
- * returns: clean_frame:  index of frame that's clean
+ * Creates the shared stats segment for this process
  *
+ *  returns: 0 on success, -1 on failure
  */
-int custom(struct page_table *pt, int page){
-    int clean_frame;
-    for (clean_frame = 0; clean_frame < NFRAMES; clean_frame++){
-        if (FT.permissions[clean_frame] == 1){
-            return clean_frame;
-        }
+int init_stats(){
+    struct timespec now;
+    STATS = stats_create();
+    if (!STATS){
+        return -1;
     }
-    clean_frame = fifo(pt, page);
-    return clean_frame;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    STATS->npages = NPAGES;
+    STATS->nframes = NFRAMES;
+    STATS->start_sec = now.tv_sec;
+    strncpy(STATS->policy, PAGE_REPLACEMENT_TYPE, sizeof(STATS->policy) - 1);
+    strncpy(STATS->program, PROGRAM, sizeof(STATS->program) - 1);
+    return 0;
 }
 
-
 /*
- * Function:  get_new_frame_num()
+ * Function:  init_regions
  * --------------------
- * Determines a new frame number depending on the page
- * replacement algorithm selected
- *
- *  pt:     pointer to the page table
- *  page:   page associated with the page fault
- *
- * returns: n:  index of new frame number
- *
+ * Starts every region unclassified with no evicted pages
  */
-int get_new_frame_num(struct page_table *pt, int page){
-    int n;
-    if (strcmp(PAGE_REPLACEMENT_TYPE, "rand") == 0){
-        n = rand_func();
-    }
-    else if (strcmp(PAGE_REPLACEMENT_TYPE, "fifo") == 0){
-        n = fifo(pt, page);
+void init_regions(){
+    int r;
+    memset(PAGE_EVICTED, 0, NPAGES);
+    memset(REGION_TABLE, 0, NUM_REGIONS * sizeof(struct region));
+    for (r = 0; r < NUM_REGIONS; r++){
+        REGION_TABLE[r].last_page = -2;
     }
-    else if (strcmp(PAGE_REPLACEMENT_TYPE, "custom") == 0){
-        n = custom(pt, page);
-    }
-    return n;
 }
 
 /*
- * Function:  evict_frame()
+ * Function:  fork_child
  * --------------------
- * Continously calls get_new_frame_num() until it finds an
- * entry that HAS data in it to evict.  In other words, it
- * will return an entry that is not free.
- *
- *  pt:     pointer to the page table
- *  page:   page associated with the page fault
- *
- * returns: n:  index of new FREE frame number
+ * Turns a forked child into a fresh run of one configuration: the
+ * resident set is dropped, the frame table and counters are reset and
+ * the disk is cloned, so only the rest of the program is measured
  *
+ *  config: index of the configuration in FORK_POLICIES/FORK_FRAMES
  */
-int get_evict_frame(struct page_table *pt, int page){
-    int frame_to_evict;
-    frame_to_evict = get_new_frame_num(pt, page);
-    while (FT.frames[frame_to_evict] == 0){
-        frame_to_evict = get_new_frame_num(pt, page);
+void fork_child(int config){
+    int page, fn, bits;
+    
+    for (page = 0; page < NPAGES; page++){
+        page_table_get_entry(PAGE_TABLE, page, &fn, &bits);
+        if (bits != 0){
+            page_table_set_entry(PAGE_TABLE, page, 0, 0);
+        }
+    }
+    
+    PAGE_REPLACEMENT_TYPE = FORK_POLICIES[config];
+    NFRAMES = FORK_FRAMES[config];
+    free(FT.frames);
+    free(FT.free_frames);
+    frame_table_init(NFRAMES);
+    if (NUM_REGIONS){
+        init_regions();
+    }
+    
+    NUM_PAGE_FAULTS = NUM_DISK_READS = NUM_DISK_WRITES = NUM_BYTES_WRITTEN = 0;
+    NUM_BYTES_COPIED = FAULT_NS = TIMED_FAULTS = 0;
+    NUM_DIRECT_WRITE_MAPS = 0;
+    TIER_FAST_HITS = TIER_SLOW_HITS = TIER_PROMOTIONS = TIER_DEMOTIONS = TIER_SAMPLE_FAULTS = 0;
+    RECLAIM_BATCHES = RECLAIM_FRAMES = INLINE_RECLAIMS = 0;
+    REGION_SEQ_VICTIMS = REGION_LOOP_VICTIMS = 0;
+    NUM_PINNED_FRAMES = 0;
+    HINT_READAHEAD_PAGES = HINT_DROP_BEHIND = HINT_PREFETCHED = HINT_DROPPED = HINT_SKIPPED_READS = 0;
+    STARTUP_FAULTS = -1;
+    
+    // The trivial mapping never reads the disk, so put every page in its own frame now
+    if (NFRAMES == NPAGES && !ZERO_COPY){
+        for (page = 0; page < NPAGES; page++){
+            disk_read(DISK, page, frame_data(page));
+        }
+    }
+    
+    snprintf(FORK_DISK_NAME, sizeof(FORK_DISK_NAME), "myvirtualdisk.%d", (int)getpid());
+    if (disk_clone(DISK, FORK_DISK_NAME) < 0 ||
+        (ZERO_COPY && page_table_set_backing(PAGE_TABLE, disk_fd(DISK)) < 0)){
+        fprintf(stderr,"couldn't clone virtual disk: %s\n",strerror(errno));
+        exit(1);
     }
-    return frame_to_evict;
+    if (STATS){
+        stats_close(STATS, 0);
+        if (init_stats() < 0){
+            fprintf(stderr,"couldn't create stats segment: %s\n",strerror(errno));
+            exit(1);
+        }
+    }
+    
+    printf("Selected %s (%d frames from checkpoint %s) \n", PAGE_REPLACEMENT_TYPE, NFRAMES, CHECKPOINT_NAME);
 }
 
 /*
- * Function:  evict_frame()
+ * Function:  fork_server
  * --------------------
- * Actually evict the frame
- *
- *  frame_to_evict:     Frame number to evict
+ * Checkpoint hook for the fork server.  At the named checkpoint the
+ * resident set is written back, then one child per configuration is
+ * forked from this state and run to completion in turn; the parent
+ * exits once the last child is done
  *
+ *  name:   checkpoint the program reached
  */
-void evict_frame(int frame_to_evict){
-    // printf("Evicting frame %d ... \n", frame_to_evict);
-    FT.frames[frame_to_evict] = 0;
-    FT.permissions[frame_to_evict] = 0;
-    FT.pages[frame_to_evict] = 0;
-    FT.time_stamps[frame_to_evict] = 0;
-    TIME_STAMP_SIZE--;
+void fork_server(const char *name){
+    static bool done;
+    int config, page, fn, bits, frame, status, failed = 0;
+    pid_t pid;
     
+    if (done || strcmp(name, CHECKPOINT_NAME) != 0){
+        return;
+    }
+    done = true;
     
-    // print_frame_table();
+    // Every child starts from the same disk image with nothing resident
+    if (NFRAMES == NPAGES && !ZERO_COPY){
+        for (page = 0; page < NPAGES; page++){
+            page_table_get_entry(PAGE_TABLE, page, &fn, &bits);
+            if (bits & PROT_WRITE){
+                disk_write(DISK, page, frame_data(fn));
+            }
+        }
+    }
+    else {
+        for (frame = 0; frame < NFRAMES; frame++){
+            if (!is_frame_free(frame) && frame_is_dirty(frame)){
+                write_back_frame(frame, FT.frames[frame].page);
+                FT.frames[frame].flags &= ~FRAME_DIRTY;
+            }
+        }
+    }
+    fflush(stdout);
+    
+    for (config = 0; config < FORK_COUNT; config++){
+        pid = fork();
+        if (pid < 0){
+            fprintf(stderr,"couldn't fork: %s\n",strerror(errno));
+            exit(1);
+        }
+        if (pid == 0){
+            fork_child(config);
+            return;
+        }
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            failed = 1;
+        }
+    }
+    
+    if (STATS){
+        stats_close(STATS, 1);
+    }
+    disk_close(DISK);
+    exit(failed);
 }
 
-
-
-
 /*
- * Function:  page_fault_handler
+ * Function:  handle_page_fault
  * --------------------
  * Handles all page faults
  *
  *  pt:     pointer to the page table
  *  page:   page number that is faulty
+ *  access: PAGE_ACCESS_* kind of access that faulted
  */
-void page_fault_handler( struct page_table *pt, int page )
+void handle_page_fault( struct page_table *pt, int page, int access )
 {
     
+    // With write-fault detection a page that is being written is mapped
+    // read/write and marked dirty straight away, saving the upgrade fault
+    int load_bits = PROT_READ;
+    int load_flags = 0;
+    int direct_write = (WRITE_FAULTS && access == PAGE_ACCESS_WRITE);
+    if (direct_write){
+        load_bits = PROT_READ|PROT_WRITE;
+        load_flags = FRAME_DIRTY;
+    }
+    
+    // A zero-filled page differs from its disk block, so it starts dirty;
+    // it is counted in HINT_SKIPPED_READS rather than as a direct write map
+    if (PAGE_HINTS && (PAGE_HINTS[page] & PAGE_HINT_ZERO)){
+        load_bits = PROT_READ|PROT_WRITE;
+        load_flags = FRAME_DIRTY;
+    }
+    
+    // Faults that only exist to sample references are not page faults
+    if (TIER_FAST_FRAMES && sampled_reference(pt, page)){
+        return;
+    }
+    
     // printf("\n\n************************PAGE FAULT PROBLEM # %d ************************ \n", NUM_PAGE_FAULTS);
     // printf("page_fault_handler: entered func \n");
     NUM_PAGE_FAULTS++;
+    if (STATS){
+        publish_stats(1);
+    }
+    if (TIER_FAST_FRAMES && NUM_PAGE_FAULTS % TIER_SAMPLE_INTERVAL == 0){
+        sample_references(pt, page);
+    }
     
     int bits;
     //int frame_bits;
@@ -358,6 +1682,11 @@ void page_fault_handler( struct page_table *pt, int page )
     // Get the page table entry
     // printf("page_fault_handler:  page_table_get_entry starting... \n");
     page_table_get_entry(pt, page, &fn, &bits);
+    
+    // Classify the miss stream of the page's region
+    if (NUM_REGIONS && bits == 0){
+        region_note_fault(page);
+    }
     /*printf("page_fault_handler:  page_table_get_entry completed \n");
     printf("**GET ENTRY SUMMARY**\n");
     printf("PAGE NUMBER:\t%d \n", page);
@@ -379,21 +1708,24 @@ void page_fault_handler( struct page_table *pt, int page )
         int new_fn;
         new_fn=get_initial_frame();
         
+        // New pages always start in the fast tier
+        if (TIER_FAST_FRAMES && new_fn >= TIER_FAST_FRAMES){
+            new_fn = demote_fast_frame(pt, page, new_fn);
+        }
+        
         // Set the entry in the page table
-        page_table_set_entry(pt, page, new_fn, PROT_READ);
+        page_table_set_entry(pt, page, new_fn, load_bits);
         
         // Update the global frame table
-        FT.frames[new_fn] = 1;
-        FT.permissions[new_fn] = 1;
-        FT.pages[new_fn] = page;
-        FT.time_stamps[new_fn] = TIME_STAMP_SIZE;
-        TIME_STAMP_SIZE++;
+        use_frame(new_fn, page, load_flags);
+        if (direct_write){
+            NUM_DIRECT_WRITE_MAPS++;
+        }
         
         // print_frame_table();
         
         // Handle the disk
-        disk_read(DISK, page, &PHYSMEM[new_fn*FRAME_SIZE]);
-        NUM_DISK_READS++;
+        load_frame(new_fn, page);
         
         
         /*printf("page_fault_handler: finished adding read permissions  \n");
@@ -401,6 +1733,10 @@ void page_fault_handler( struct page_table *pt, int page )
         // page_table_print(pt);
         printf("page_fault_handler:     Frame table printout: \n");
         // print_frame_table();*/
+        if (PAGE_HINTS){
+            follow_hints(pt, page, new_fn);
+        }
+        reclaim_if_low(pt, page);
         return;
     }
     else if (bits == PROT_READ){ // Only read permissions
@@ -413,8 +1749,8 @@ void page_fault_handler( struct page_table *pt, int page )
         // page_table_print(pt);
         
         
-        // Update the frame table permissions for that frame to be 3 (read & write)
-        FT.permissions[fn] = 3;
+        // Mark the frame dirty so it is written back on eviction
+        FT.frames[fn].flags |= FRAME_DIRTY;
         // printf("page_fault_handler:     frame table after updating to 3 \n");
         // print_frame_table();
         
@@ -430,12 +1766,19 @@ void page_fault_handler( struct page_table *pt, int page )
         printf("page_fault_handler:     Page table printout: \n");
         // page_table_print(pt);*/
         
-        // Get the frame to evict
-        new_fn = get_evict_frame(pt, page);
+        // The startup phase ends with the first eviction
+        end_startup(NUM_PAGE_FAULTS - 1);
+        
+        // The free pool ran dry, so this fault pays for the eviction
+        INLINE_RECLAIMS++;
+        
+        // Get the frame to evict; with tiers only slow pages go to disk
+        new_fn = get_evict_frame(pt, page, TIER_FAST_FRAMES, NFRAMES);
         // printf("Kicking out frame %d\n", new_fn);
-        int page_num, old_bits;
-        page_num = FT.pages[new_fn];
-        old_bits = FT.permissions[new_fn];
+        int page_num;
+        bool was_dirty;
+        page_num = FT.frames[new_fn].page;
+        was_dirty = frame_is_dirty(new_fn);
         // Getting info for entry being kicked out
         /*printf("**ENTRY BEING KICKED OUT SUMMARY WITH OLD BITS**\n");
         printf("PAGE NUMBER:\t%d \n", page_num);
@@ -445,19 +1788,21 @@ void page_fault_handler( struct page_table *pt, int page )
         
         // Evicting the frame
         evict_frame(new_fn);
+        if (PAGE_EVICTED){
+            PAGE_EVICTED[page_num] = 1;
+        }
         /*
         if (!strcmp(PAGE_REPLACEMENT_TYPE,"fifo")){
             handle_fifo_table(new_fn);
         }*/
         
         
-        if (old_bits == 3){
+        if (was_dirty){
             /*printf("************************************ \n");
             printf("WRITE IS HAPPENING HERE ************ \n");
             printf("************************************ \n");
             printf("page_fault_handler:     Bits are read and write \n");*/
-            disk_write(DISK, page_num, &PHYSMEM[0*PAGE_SIZE]);
-            NUM_DISK_WRITES++;
+            write_back_frame(new_fn, page_num);
         }
         
         
@@ -468,23 +1813,29 @@ void page_fault_handler( struct page_table *pt, int page )
         // printf("*****************FRAME TABLE BEFORE UPDATE*****************\n");
         // print_frame_table();
         
-        FT.frames[new_fn] = 1;
-        FT.permissions[new_fn] = 1;
-        FT.pages[new_fn]=page;
-        FT.time_stamps[new_fn] = TIME_STAMP_SIZE;
-        TIME_STAMP_SIZE++;
+        if (TIER_FAST_FRAMES){
+            new_fn = demote_fast_frame(pt, page, new_fn);
+        }
+        
+        use_frame(new_fn, page, load_flags);
+        if (direct_write){
+            NUM_DIRECT_WRITE_MAPS++;
+        }
         
         // printf("*****************FRAME TABLE AFTER UPDATE*****************\n");
         // print_frame_table();
     
-        disk_read(DISK, page, &PHYSMEM[0*PAGE_SIZE]);
-        page_table_set_entry(pt, page, new_fn, PROT_READ);
+        load_frame(new_fn, page);
+        page_table_set_entry(pt, page, new_fn, load_bits);
         page_table_set_entry(pt, page_num, 0, 0);
+        if (PAGE_HINTS){
+            follow_hints(pt, page, new_fn);
+        }
+        reclaim_if_low(pt, page);
         /*printf("***********END OF FRAME IS FULL!!!!! page_fault_handler:     Page table printout: \n");
         // page_table_print(pt);
         printf("frame_table at end of frame table is full %d \n", new_fn);*/
         // print_frame_table();
-        NUM_DISK_READS++;
         
     }
     // There are no more free frames in physical memory
@@ -495,6 +1846,40 @@ void page_fault_handler( struct page_table *pt, int page )
     
 }
 
+/*
+ * Function:  page_fault_handler
+ * --------------------
+ * Entry point for page faults.  Times the handler when fault timing is
+ * on, and with zero-copy paging touches a newly mapped page so pulling
+ * it in from the page cache is part of the fault rather than the retry.
+ *
+ *  pt:     pointer to the page table
+ *  page:   page number that is faulty
+ *  access: PAGE_ACCESS_* kind of access that faulted
+ */
+void page_fault_handler( struct page_table *pt, int page, int access )
+{
+    struct timespec start, end;
+    int fn, bits;
+    
+    if (!FAULT_TIMING){
+        handle_page_fault(pt, page, access);
+        return;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    handle_page_fault(pt, page, access);
+    if (ZERO_COPY){
+        page_table_get_entry(pt, page, &fn, &bits);
+        if (bits & PROT_READ){
+            (void)*(volatile char *)(page_table_get_virtmem(pt) + (size_t)page * PAGE_SIZE);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    FAULT_NS += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    TIMED_FAULTS++;
+}
+
 /*
  * Function:  print_summary
  * --------------------
@@ -505,9 +1890,10 @@ void print_summary(){
     printf("-------------------------------------------\n");
     printf("                  SUMMARY                  \n");
     printf("-------------------------------------------\n");
-    printf("  * NUM_PAGE_FAULTS: %d \n", NUM_PAGE_FAULTS);
-    printf("  * NUM_DISK_READS: %d \n", NUM_DISK_READS);
-    printf("  * NUM_DISK_WRITES: %d \n", NUM_DISK_WRITES);
+    printf("  * NUM_PAGE_FAULTS: %lld \n", NUM_PAGE_FAULTS);
+    printf("  * NUM_DISK_READS: %lld \n", NUM_DISK_READS);
+    printf("  * NUM_DISK_WRITES: %lld \n", NUM_DISK_WRITES);
+    printf("  * NUM_BYTES_WRITTEN: %lld \n", NUM_BYTES_WRITTEN);
     printf("-------------------------------------------\n");
 }
 
@@ -519,15 +1905,271 @@ void print_summary(){
  * and disk reads for the csv output
  */
 void print_summary_csv(){
-    printf("%d, %d, %d", NUM_PAGE_FAULTS, NUM_DISK_READS, NUM_DISK_WRITES);
+    printf("%lld, %lld, %lld", NUM_PAGE_FAULTS, NUM_DISK_READS, NUM_DISK_WRITES);
+}
+
+/*
+ * Function:  print_summary_extended
+ * --------------------
+ * Prints the statistics of any optional features that are enabled,
+ * one "NAME: value" line each, after the csv summary
+ */
+void print_summary_extended(){
+    printf("\nBYTES_WRITTEN: %lld", NUM_BYTES_WRITTEN);
+    if (WRITE_FAULTS){
+        printf("\nDIRECT_WRITE_MAPS: %lld", NUM_DIRECT_WRITE_MAPS);
+    }
+    if (WARM_START_FILE){
+        printf("\nWARM_START_PAGES: %d", WARM_START_PAGES);
+        printf("\nWARM_START_WRITES: %lld", WARM_START_WRITES);
+        printf("\nSTARTUP_FAULTS: %lld", STARTUP_FAULTS < 0 ? NUM_PAGE_FAULTS : STARTUP_FAULTS);
+    }
+    if (LOG_SEGMENT_BLOCKS){
+        printf("\nLOG_SEGMENTS_CLEANED: %lld", LOG_SEGMENTS_CLEANED);
+        printf("\nLOG_BLOCKS_MOVED: %lld", LOG_BLOCKS_MOVED);
+    }
+    // Sampled references stand in for all references to their tier
+    long long tier_ns = 0;
+    if (TIER_FAST_FRAMES){
+        long long hits = TIER_FAST_HITS + TIER_SLOW_HITS;
+        tier_ns = (TIER_FAST_HITS * TIER_FAST_NS + TIER_SLOW_HITS * TIER_SLOW_NS)
+                + (TIER_PROMOTIONS + TIER_DEMOTIONS) * TIER_MIGRATE_NS;
+        printf("\nTIER_FAST_FRAMES: %d", TIER_FAST_FRAMES);
+        printf("\nTIER_SLOW_FRAMES: %d", NFRAMES - TIER_FAST_FRAMES);
+        printf("\nTIER_SAMPLE_FAULTS: %lld", TIER_SAMPLE_FAULTS);
+        printf("\nTIER_FAST_HITS: %lld", TIER_FAST_HITS);
+        printf("\nTIER_SLOW_HITS: %lld", TIER_SLOW_HITS);
+        printf("\nTIER_FAST_HIT_RATE: %.4f", hits ? (double)TIER_FAST_HITS / hits : 0.0);
+        printf("\nTIER_PROMOTIONS: %lld", TIER_PROMOTIONS);
+        printf("\nTIER_DEMOTIONS: %lld", TIER_DEMOTIONS);
+        printf("\nSIM_TIER_NS: %lld", tier_ns);
+    }
+    if (RECLAIM_LOW){
+        printf("\nRECLAIM_BATCHES: %lld", RECLAIM_BATCHES);
+        printf("\nRECLAIM_AVG_BATCH: %.2f", RECLAIM_BATCHES ? (double)RECLAIM_FRAMES / RECLAIM_BATCHES : 0.0);
+        printf("\nINLINE_RECLAIMS: %lld", INLINE_RECLAIMS);
+        printf("\nINLINE_RECLAIM_RATE: %.4f", NUM_PAGE_FAULTS ? (double)INLINE_RECLAIMS / NUM_PAGE_FAULTS : 0.0);
+    }
+    if (NUM_REGIONS){
+        int r, patterns[3] = {0, 0, 0};
+        for (r = 0; r < NUM_REGIONS; r++){
+            patterns[REGION_TABLE[r].pattern]++;
+        }
+        printf("\nREGIONS_RANDOM: %d", patterns[REGION_RANDOM]);
+        printf("\nREGIONS_SEQUENTIAL: %d", patterns[REGION_SEQUENTIAL]);
+        printf("\nREGIONS_LOOPING: %d", patterns[REGION_LOOPING]);
+        printf("\nREGION_SEQ_VICTIMS: %lld", REGION_SEQ_VICTIMS);
+        printf("\nREGION_LOOP_VICTIMS: %lld", REGION_LOOP_VICTIMS);
+    }
+    if (PAGE_HINTS){
+        printf("\nHINT_SKIPPED_READS: %lld", HINT_SKIPPED_READS);
+        printf("\nHINT_READAHEAD_PAGES: %lld", HINT_READAHEAD_PAGES);
+        printf("\nHINT_DROP_BEHIND: %lld", HINT_DROP_BEHIND);
+        printf("\nHINT_PREFETCHED: %lld", HINT_PREFETCHED);
+        printf("\nHINT_DROPPED: %lld", HINT_DROPPED);
+        printf("\nHINT_PINNED_FRAMES: %d", NUM_PINNED_FRAMES);
+    }
+    if (DISK_STRIPES){
+        printf("\nDISK_STRIPES: %d", DISK_STRIPES);
+        printf("\nDISK_STRIPE_UNIT: %d", DISK_STRIPE_UNIT);
+    }
+    if (FAULT_TIMING){
+        printf("\nBYTES_COPIED: %lld", NUM_BYTES_COPIED);
+        printf("\nBYTES_COPIED_PER_FAULT: %.1f", NUM_PAGE_FAULTS ? (double)NUM_BYTES_COPIED / NUM_PAGE_FAULTS : 0.0);
+        printf("\nAVG_FAULT_NS: %lld", TIMED_FAULTS ? FAULT_NS / TIMED_FAULTS : 0);
+    }
+    if (LATENCY_ENABLED){
+        // Virtual clock: simulated I/O time plus a fixed CPU cost per fault
+        long long fault_ns = NUM_PAGE_FAULTS * FAULT_CPU_NS;
+        printf("\nSIM_DISK_NS: %lld", SIM_DISK_NS);
+        printf("\nSIM_FAULT_CPU_NS: %lld", fault_ns);
+        printf("\nSIM_TOTAL_NS: %lld", SIM_DISK_NS + fault_ns + tier_ns);
+    }
+    printf("\n");
+}
+
+
+/*
+ * Function:  parse_option
+ * --------------------
+ * Parses a single "key=value" runtime option
+ *
+ *  arg:    argument from the command line
+ *
+ *  returns:  1:  option was recognized and stored
+ *            0:  option is not a runtime option
+ *           -1:  option was recognized but its value is invalid
+ */
+int parse_option(const char *arg){
+    if (strncmp(arg, "disk=", 5) == 0){
+        DISK_BACKEND = disk_backend_from_name(arg + 5);
+        return DISK_BACKEND < 0 ? -1 : 1;
+    }
+    if (strncmp(arg, "stripes=", 8) == 0){
+        DISK_STRIPES = atoi(arg + 8);
+        return (DISK_STRIPES > 0 && DISK_STRIPES <= 64) ? 1 : -1;
+    }
+    if (strncmp(arg, "stripe_unit=", 12) == 0){
+        DISK_STRIPE_UNIT = atoi(arg + 12);
+        return DISK_STRIPE_UNIT > 0 ? 1 : -1;
+    }
+    
+    // Latency model: a preset first, then any individual overrides
+    if (strncmp(arg, "latency=", 8) == 0){
+        LATENCY_ENABLED = true;
+        return disk_latency_from_name(arg + 8, &LATENCY) < 0 ? -1 : 1;
+    }
+    if (strncmp(arg, "io_ns=", 6) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.io_ns = atoll(arg + 6);
+        return 1;
+    }
+    if (strncmp(arg, "seek_ns=", 8) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.seek_ns = atoll(arg + 8);
+        return 1;
+    }
+    if (strncmp(arg, "seek_ns_per_block=", 18) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.seek_ns_per_block = atoll(arg + 18);
+        return 1;
+    }
+    if (strncmp(arg, "max_seek_ns=", 12) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.max_seek_ns = atoll(arg + 12);
+        return 1;
+    }
+    if (strncmp(arg, "byte_ns=", 8) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.ns_per_byte = atof(arg + 8);
+        return 1;
+    }
+    if (strncmp(arg, "qd=", 3) == 0){
+        LATENCY_ENABLED = true;
+        LATENCY.queue_depth = atoi(arg + 3);
+        return LATENCY.queue_depth > 0 ? 1 : -1;
+    }
+    if (strcmp(arg, "swap=log") == 0){
+        if (LOG_SEGMENT_BLOCKS == 0){
+            LOG_SEGMENT_BLOCKS = 64;
+        }
+        return 1;
+    }
+    if (strcmp(arg, "swap=linear") == 0){
+        LOG_SEGMENT_BLOCKS = 0;
+        return 1;
+    }
+    if (strncmp(arg, "segment=", 8) == 0){
+        LOG_SEGMENT_BLOCKS = atoi(arg + 8);
+        return LOG_SEGMENT_BLOCKS > 0 ? 1 : -1;
+    }
+    if (strcmp(arg, "writefault=1") == 0 || strcmp(arg, "writefault=0") == 0){
+        WRITE_FAULTS = (arg[11] == '1');
+        return 1;
+    }
+    if (strncmp(arg, "warmstart=", 10) == 0){
+        WARM_START_FILE = arg + 10;
+        return WARM_START_FILE[0] ? 1 : -1;
+    }
+    if (strcmp(arg, "delta=1") == 0 || strcmp(arg, "delta=0") == 0){
+        DELTA_WRITEBACK = (arg[6] == '1');
+        return 1;
+    }
+    if (strcmp(arg, "delta=check") == 0){
+        // Test entry point used by check_delta.sh: check the hash and exit
+        DELTA_WRITEBACK = DELTA_CHECK = true;
+        return 1;
+    }
+    if (strncmp(arg, "fault_ns=", 9) == 0){
+        LATENCY_ENABLED = true;
+        FAULT_CPU_NS = atoll(arg + 9);
+        return FAULT_CPU_NS >= 0 ? 1 : -1;
+    }
+    
+    // Two-tier memory: the first "tiers" frames are the fast tier
+    if (strncmp(arg, "tiers=", 6) == 0){
+        TIER_FAST_FRAMES = atoi(arg + 6);
+        return TIER_FAST_FRAMES > 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "fast_ns=", 8) == 0){
+        TIER_FAST_NS = atoll(arg + 8);
+        return TIER_FAST_NS >= 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "slow_ns=", 8) == 0){
+        TIER_SLOW_NS = atoll(arg + 8);
+        return TIER_SLOW_NS >= 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "migrate_ns=", 11) == 0){
+        TIER_MIGRATE_NS = atoll(arg + 11);
+        return TIER_MIGRATE_NS >= 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "sample=", 7) == 0){
+        TIER_SAMPLE_INTERVAL = atoi(arg + 7);
+        return TIER_SAMPLE_INTERVAL > 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "promote=", 8) == 0){
+        TIER_PROMOTE_REFS = atoi(arg + 8);
+        return TIER_PROMOTE_REFS > 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "wmark=", 6) == 0){
+        if (sscanf(arg + 6, "%d,%d", &RECLAIM_LOW, &RECLAIM_HIGH) != 2){
+            return -1;
+        }
+        return (RECLAIM_LOW > 0 && RECLAIM_HIGH >= RECLAIM_LOW) ? 1 : -1;
+    }
+    if (strncmp(arg, "regions=", 8) == 0){
+        NUM_REGIONS = atoi(arg + 8);
+        return NUM_REGIONS >= 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "fork=", 5) == 0){
+        // Comma separated policy[:frames] list
+        char spec[256], *config, *frames, *save;
+        strncpy(spec, arg + 5, sizeof(spec) - 1);
+        spec[sizeof(spec) - 1] = 0;
+        FORK_COUNT = 0;
+        for (config = strtok_r(spec, ",", &save); config; config = strtok_r(NULL, ",", &save)){
+            if (FORK_COUNT == FORK_MAX_CONFIGS){
+                return -1;
+            }
+            frames = strchr(config, ':');
+            if (frames){
+                *frames++ = 0;
+            }
+            if (strcmp(config, "rand") && strcmp(config, "fifo") && strcmp(config, "custom")){
+                return -1;
+            }
+            strcpy(FORK_POLICIES[FORK_COUNT], config);
+            FORK_FRAMES[FORK_COUNT] = frames ? atoi(frames) : NFRAMES;
+            if (FORK_FRAMES[FORK_COUNT] <= 0 || FORK_FRAMES[FORK_COUNT] > NPAGES){
+                return -1;
+            }
+            FORK_COUNT++;
+        }
+        return FORK_COUNT > 0 ? 1 : -1;
+    }
+    if (strncmp(arg, "checkpoint=", 11) == 0){
+        CHECKPOINT_NAME = arg + 11;
+        return CHECKPOINT_NAME[0] ? 1 : -1;
+    }
+    if (strcmp(arg, "zerocopy=1") == 0 || strcmp(arg, "zerocopy=0") == 0){
+        // Either setting reports the copy counters, so the two paths can be compared
+        ZERO_COPY = (arg[9] == '1');
+        FAULT_TIMING = true;
+        return 1;
+    }
+    if (strcmp(arg, "stats=1") == 0 || strcmp(arg, "stats=0") == 0){
+        STATS_ENABLED = (arg[6] == '1');
+        return 1;
+    }
+    return 0;
 }
 
 
 // Main execution
 int main( int argc, char *argv[] )
 {
-	if(argc!=5) {
-		printf("use: virtmem <NPAGES> <NFRAMES> <rand|fifo|custom> <sort|scan|focus>\n");
+	if(argc<5) {
+		printf("use: virtmem <NPAGES> <NFRAMES> <rand|fifo|custom> <sort|scan|focus|sort-hinted|scan-hinted|focus-hinted|zipf|uniform|stride|loop|matmul|hash|phase|trace> [key=value ...]\n");
 		return 1;
 	}
 	
@@ -541,40 +2183,160 @@ int main( int argc, char *argv[] )
     NUM_PAGE_FAULTS = 0;
     NUM_DISK_READS = 0;
     NUM_DISK_WRITES = 0;
-    TIME_STAMP_SIZE = 0;
+    NUM_BYTES_WRITTEN = 0;
+    
+    // Process optional key=value arguments
+    workload_options_init(&WORKLOAD_OPTS);
+    DISK_BACKEND = DISK_BACKEND_FILE;
+    DISK_STRIPES = 0;
+    DISK_STRIPE_UNIT = 1;
+    disk_latency_from_name("none", &LATENCY);
+    LATENCY_ENABLED = false;
+    FAULT_CPU_NS = 2000;
+    DELTA_WRITEBACK = false;
+    DELTA_CHECK = false;
+    LOG_SEGMENT_BLOCKS = 0;
+    WARM_START_FILE = NULL;
+    WARM_START_PAGES = 0;
+    STARTUP_FAULTS = -1;
+    WRITE_FAULTS = false;
+    NUM_DIRECT_WRITE_MAPS = 0;
+    TIER_FAST_FRAMES = 0;
+    TIER_FAST_NS = 100;
+    TIER_SLOW_NS = 300;
+    TIER_MIGRATE_NS = 1000;
+    TIER_SAMPLE_INTERVAL = 4;
+    TIER_PROMOTE_REFS = 2;
+    TIER_SEED = 1;
+    RECLAIM_LOW = 0;
+    RECLAIM_HIGH = 0;
+    NUM_REGIONS = 0;
+    STATS_ENABLED = false;
+    STATS = NULL;
+    CHECKPOINT_NAME = "fill";
+    FORK_COUNT = 0;
+    FORK_DISK_NAME[0] = 0;
+    ZERO_COPY = false;
+    PAGE_HINTS = NULL;
+    NUM_PINNED_FRAMES = 0;
+    FAULT_TIMING = false;
+    int arg, parsed, status;
+    for (arg = 5; arg < argc; arg++){
+        parsed = workload_parse_option(&WORKLOAD_OPTS, argv[arg]);
+        if (parsed == 0){
+            parsed = parse_option(argv[arg]);
+        }
+        if (parsed <= 0){
+            fprintf(stderr,"invalid option: %s\n",argv[arg]);
+            return 1;
+        }
+    }
     
 	// Create virtual disk
-	DISK = disk_open("myvirtualdisk",NPAGES);
+	if(DISK_STRIPES && (ZERO_COPY || LOG_SEGMENT_BLOCKS || FORK_COUNT ||
+	                    (DISK_BACKEND != DISK_BACKEND_FILE && DISK_BACKEND != DISK_BACKEND_DIRECT))) {
+		fprintf(stderr,"stripes needs the file or direct disk and cannot be combined with swap=log, zerocopy or fork\n");
+		return 1;
+	}
+	if(DISK_STRIPES) {
+		DISK = disk_open_striped("myvirtualdisk",NPAGES,DISK_BACKEND,DISK_STRIPES,DISK_STRIPE_UNIT);
+	} else {
+		DISK = disk_open_backend("myvirtualdisk",NPAGES,DISK_BACKEND);
+	}
 	if(!DISK) {
 		fprintf(stderr,"couldn't create virtual disk: %s\n",strerror(errno));
 		return 1;
 	}
+	if(LATENCY_ENABLED) {
+		disk_set_latency(DISK,&LATENCY);
+	}
+	if(WARM_START_FILE && (DISK_BACKEND == DISK_BACKEND_RAM || LOG_SEGMENT_BLOCKS)) {
+		fprintf(stderr,"warmstart needs a disk that persists between runs\n");
+		return 1;
+	}
+	if(TIER_FAST_FRAMES && (TIER_FAST_FRAMES >= NFRAMES || NFRAMES == NPAGES)) {
+		fprintf(stderr,"tiers needs fewer fast frames than frames, and fewer frames than pages\n");
+		return 1;
+	}
+	if(RECLAIM_LOW && (RECLAIM_HIGH >= NFRAMES - TIER_FAST_FRAMES || NFRAMES == NPAGES)) {
+		fprintf(stderr,"wmark high must be below the number of evictable frames\n");
+		return 1;
+	}
+	// The page table and per-frame state are sized for the largest run
+	int table_frames = NFRAMES;
+	if(FORK_COUNT) {
+		int config;
+		if(WARM_START_FILE) {
+			fprintf(stderr,"fork and warmstart cannot be combined\n");
+			return 1;
+		}
+		for(config=0;config<FORK_COUNT;config++) {
+			int frames = FORK_FRAMES[config];
+			if((TIER_FAST_FRAMES && (TIER_FAST_FRAMES >= frames || frames == NPAGES)) ||
+			   (RECLAIM_LOW && (RECLAIM_HIGH >= frames - TIER_FAST_FRAMES || frames == NPAGES))) {
+				fprintf(stderr,"tiers or wmark do not fit in %d frames\n",frames);
+				return 1;
+			}
+			if(frames > table_frames) table_frames = frames;
+		}
+	}
+	if(ZERO_COPY && (DISK_BACKEND == DISK_BACKEND_RAM || DISK_BACKEND == DISK_BACKEND_DIRECT ||
+	                 LOG_SEGMENT_BLOCKS || DELTA_WRITEBACK || TIER_FAST_FRAMES || WARM_START_FILE)) {
+		fprintf(stderr,"zerocopy needs the file or mmap disk and cannot be combined with swap=log, delta, tiers or warmstart\n");
+		return 1;
+	}
+	if(LOG_SEGMENT_BLOCKS && disk_set_log_layout(DISK,LOG_SEGMENT_BLOCKS) < 0) {
+		fprintf(stderr,"couldn't set up log-structured swap: %s\n",strerror(errno));
+		return 1;
+	}
 
 	// Initialize page_table
-	struct page_table *pt = page_table_create( NPAGES, NFRAMES, page_fault_handler );
+	struct page_table *pt = page_table_create_access( NPAGES, table_frames, page_fault_handler );
     
     
 	if(!pt) {
 		fprintf(stderr,"couldn't create page table: %s\n",strerror(errno));
 		return 1;
 	}
+	PAGE_TABLE = pt;
+	page_table_set_advice_handler(pt,advise_pages);
+	if(ZERO_COPY && page_table_set_backing(pt,disk_fd(DISK)) < 0) {
+		fprintf(stderr,"couldn't map the virtual disk: %s\n",strerror(errno));
+		return 1;
+	}
+	if(FORK_COUNT) {
+		program_set_checkpoint(fork_server);
+	}
     
     // Create frame_table & initialize as empty
     
-    FT.frames = (int*)malloc(sizeof(int) * NFRAMES);
-    FT.time_stamps = (int*)malloc(sizeof(int) * NFRAMES);
-    FT.permissions = (int*)malloc(sizeof(int) * NFRAMES);
-    FT.pages = (int*)malloc(sizeof(int) * NFRAMES);
-    int i;
-    for (i = 0; i < NFRAMES; i++){
-        FT.frames[i] = 0; // Initialize all frames to 0; will be equal to 1 if they are filled
-        FT.pages[i] = 0; // Initialize all pages to 0
-        FT.permissions[i] = 0; // Initialize all permissions to 0; will be set to another num when filled
-        FT.time_stamps[i] = 0; // Initialize all permissions to 0; will be set to another num when filled
-    }
+    frame_table_init(NFRAMES);
     
     // print_frame_table();
     
+    if (NUM_REGIONS){
+        if (NUM_REGIONS > NPAGES){
+            NUM_REGIONS = NPAGES;
+        }
+        REGION_PAGES = (NPAGES + NUM_REGIONS - 1) / NUM_REGIONS;
+        NUM_REGIONS = (NPAGES + REGION_PAGES - 1) / REGION_PAGES;
+        REGION_TABLE = calloc(NUM_REGIONS, sizeof(struct region));
+        PAGE_EVICTED = calloc(NPAGES, 1);
+        init_regions();
+    }
+    
+    if (DELTA_WRITEBACK){
+        SECTOR_SUMS = calloc((size_t)table_frames * DISK_SECTORS_PER_BLOCK, sizeof(unsigned long long));
+        PHYSMEM = page_table_get_physmem(pt);
+        if (DELTA_CHECK){
+            if (check_sector_hash(0) < 0){
+                return 1;
+            }
+            printf("delta: every bit flip of a frame is detected\n");
+            return 0;
+        }
+    }
+    
 	// Create virual and physical memory space
 	char *virtmem = page_table_get_virtmem(pt);
 	PHYSMEM = page_table_get_physmem(pt);
@@ -594,25 +2356,75 @@ int main( int argc, char *argv[] )
 		return 1;
 	}
 	
+    // Create the stats segment only once the arguments are known to be good
+    if (STATS_ENABLED && init_stats() < 0){
+        fprintf(stderr,"couldn't create stats segment: %s\n",strerror(errno));
+        return 1;
+    }
+    
+	if(WARM_START_FILE && NFRAMES != NPAGES) {
+		WARM_START_PAGES = restore_warm_start(pt,WARM_START_FILE);
+	}
+	
+	program_checkpoint("start");
+
 	// Program case structure
 	if(!strcmp(PROGRAM,"sort")) {
-		sort_program(virtmem,NPAGES*PAGE_SIZE);
+		sort_program(virtmem,(long)NPAGES*PAGE_SIZE);
 
 	} else if(!strcmp(PROGRAM,"scan")) {
-		scan_program(virtmem,NPAGES*PAGE_SIZE);
+		scan_program(virtmem,(long)NPAGES*PAGE_SIZE);
 
 	} else if(!strcmp(PROGRAM,"focus")) {
-		focus_program(virtmem,NPAGES*PAGE_SIZE);
+		focus_program(virtmem,(long)NPAGES*PAGE_SIZE);
 
-	} else {
-		fprintf(stderr,"unknown program: %s\n",argv[4]);
+	} else if(!strcmp(PROGRAM,"sort-hinted")) {
+		sort_hinted_program(virtmem,(long)NPAGES*PAGE_SIZE);
+
+	} else if(!strcmp(PROGRAM,"scan-hinted")) {
+		scan_hinted_program(virtmem,(long)NPAGES*PAGE_SIZE);
+
+	} else if(!strcmp(PROGRAM,"focus-hinted")) {
+		focus_hinted_program(virtmem,(long)NPAGES*PAGE_SIZE);
+
+	} else if(!strcmp(PROGRAM,"trace")) {
+		trace_program(virtmem,(long)NPAGES*PAGE_SIZE,WORKLOAD_OPTS.trace);
+
+	} else if((status = workload_run(PROGRAM,virtmem,(long)NPAGES*PAGE_SIZE,&WORKLOAD_OPTS)) < 0) {
+		if(status == -1) {
+			fprintf(stderr,"unknown program: %s\n",argv[4]);
+		}
+		if(STATS) {
+			stats_close(STATS, 1);
+		}
 		return 1;
 	}
 
+	// Saving the snapshot is not part of the program's run, so stop the clock first
+	SIM_DISK_NS = disk_elapsed_ns(DISK);
+	if(WARM_START_FILE && NFRAMES != NPAGES && save_warm_start(WARM_START_FILE) < 0) {
+		fprintf(stderr,"couldn't write warm start snapshot %s: %s\n",WARM_START_FILE,strerror(errno));
+	}
+
 	page_table_delete(pt);
+	disk_log_stats(DISK,&LOG_SEGMENTS_CLEANED,&LOG_BLOCKS_MOVED);
 	disk_close(DISK);
+	if(FORK_DISK_NAME[0]) {
+		unlink(FORK_DISK_NAME);
+	} else if(FORK_COUNT) {
+		fprintf(stderr,"checkpoint %s was never reached; ran the program once\n",CHECKPOINT_NAME);
+	}
+    
+    if (STATS){
+        publish_stats(0);
+        stats_write_begin(STATS);
+        STATS->finished = 1;
+        stats_write_end(STATS);
+        stats_close(STATS, 1);
+    }
     
     print_summary_csv();
+    print_summary_extended();
 
 	return 0;
 }
@@ -1,6 +1,10 @@
 /*
-Do not modify this file.
-Make all of your changes to main.c instead.
+Software page table over a virtual memory region.
+Pages are mapped onto the physical memory file with mmap and mprotect,
+and any access to a page without the needed protection raises SIGSEGV,
+which is turned into a call to the page fault handler. Entries are kept
+in a flat array, or in a sparse radix tree when built with
+PAGE_TABLE_SPARSE.
 */
 
 #define _GNU_SOURCE
@@ -12,23 +16,193 @@ Make all of your changes to main.c instead.
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <ucontext.h>
+#include <signal.h>
 
 #include "page_table.h"
 
+/*
+With PAGE_TABLE_SPARSE the entries live in a two-level radix tree:
+a root of pointers to leaves of PT_LEAF_SIZE entries, each leaf carved
+from a chunk on the first store to one of its pages.  Memory then grows
+with the pages touched, creation does not initialize anything, and a
+lookup is two dependent loads.  Small leaves keep scattered touches
+cheap.  Pages without a leaf read as frame 0, no bits.
+*/
+
+#ifdef PAGE_TABLE_SPARSE
+
+#define PT_LEAF_BITS 6
+#define PT_LEAF_SIZE (1<<PT_LEAF_BITS)
+#define PT_CHUNK_SIZE (64*1024)
+
+struct pt_entry {
+	int frame;
+	int bits;
+};
+
+struct pt_leaf {
+	struct pt_entry entry[PT_LEAF_SIZE];
+};
+
+#endif
+
 struct page_table {
 	int fd;
 	char *virtmem;
 	int npages;
 	char *physmem;
 	int nframes;
+#ifdef PAGE_TABLE_SPARSE
+	struct pt_leaf **leaves;
+	int nleaves;
+	char *chunk;	/* chunk leaves are being carved from; its first word links to the previous chunk */
+	size_t chunk_used;
+#else
 	int *page_mapping;
 	int *page_bits;
+#endif
+	int backed;	/* virtmem maps a backing file directly, see page_table_set_backing */
 	page_fault_handler_t handler;
+	page_fault_access_handler_t access_handler;
+	page_advice_handler_t advice_handler;
 };
 
 struct page_table *the_page_table = 0;
 
+/*
+Decode whether the faulting instruction was writing.  On x86 bit 1 of the
+page fault error code that the kernel saves in the ucontext is the
+write bit; elsewhere the access is reported as unknown.
+*/
+
+static int fault_access( void *context )
+{
+#if defined(__x86_64__) || defined(__i386__)
+	ucontext_t *uc = context;
+	return (uc->uc_mcontext.gregs[REG_ERR] & 0x2) ? PAGE_ACCESS_WRITE : PAGE_ACCESS_READ;
+#else
+	return PAGE_ACCESS_UNKNOWN;
+#endif
+}
+
+#ifdef PAGE_TABLE_SPARSE
+
+/* Chunks come straight from mmap, which is safe inside the fault handler and returns zeroed memory. */
+
+static struct pt_leaf * pt_leaf_alloc( struct page_table *pt )
+{
+	char *chunk;
+
+	if(!pt->chunk || pt->chunk_used+sizeof(struct pt_leaf)>PT_CHUNK_SIZE) {
+		chunk = mmap(0,PT_CHUNK_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(chunk==MAP_FAILED) return 0;
+		*(char**)chunk = pt->chunk;
+		pt->chunk = chunk;
+		pt->chunk_used = sizeof(struct pt_leaf);	/* the first leaf-sized slot holds the link */
+	}
+
+	pt->chunk_used += sizeof(struct pt_leaf);
+	return (struct pt_leaf*)(pt->chunk + pt->chunk_used - sizeof(struct pt_leaf));
+}
+
+static void pt_store( struct page_table *pt, int page, int frame, int bits )
+{
+	struct pt_leaf **leaf = &pt->leaves[page>>PT_LEAF_BITS];
+	struct pt_entry *e;
+
+	if(!*leaf) {
+		if(!bits && !frame) return;
+		*leaf = pt_leaf_alloc(pt);
+		if(!*leaf) {
+			fprintf(stderr,"page_table_set_entry: out of memory for page #%d\n",page);
+			abort();
+		}
+	}
+
+	e = &(*leaf)->entry[page&(PT_LEAF_SIZE-1)];
+	e->frame = frame;
+	e->bits = bits;
+}
+
+static void pt_load( struct page_table *pt, int page, int *frame, int *bits )
+{
+	struct pt_leaf *leaf = pt->leaves[page>>PT_LEAF_BITS];
+
+	if(leaf) {
+		*frame = leaf->entry[page&(PT_LEAF_SIZE-1)].frame;
+		*bits = leaf->entry[page&(PT_LEAF_SIZE-1)].bits;
+	} else {
+		*frame = 0;
+		*bits = 0;
+	}
+}
+
+/* Drop every entry; "release" also frees the root. */
+
+static void pt_clear( struct page_table *pt, int release )
+{
+	char *next;
+	int i;
+
+	for(i=0;i<pt->nleaves;i++) pt->leaves[i] = 0;
+	while(pt->chunk) {
+		next = *(char**)pt->chunk;
+		munmap(pt->chunk,PT_CHUNK_SIZE);
+		pt->chunk = next;
+	}
+	if(release) free(pt->leaves);
+}
+
+static int pt_init( struct page_table *pt )
+{
+	/* A large calloc is served by fresh zero pages, so untouched parts of the root cost nothing. */
+	pt->nleaves = (pt->npages + PT_LEAF_SIZE - 1) / PT_LEAF_SIZE;
+	pt->leaves = calloc(pt->nleaves,sizeof(struct pt_leaf*));
+	pt->chunk = 0;
+	pt->chunk_used = 0;
+	return pt->leaves ? 0 : -1;
+}
+
+#else
+
+static void pt_store( struct page_table *pt, int page, int frame, int bits )
+{
+	pt->page_mapping[page] = frame;
+	pt->page_bits[page] = bits;
+}
+
+static void pt_load( struct page_table *pt, int page, int *frame, int *bits )
+{
+	*frame = pt->page_mapping[page];
+	*bits = pt->page_bits[page];
+}
+
+static void pt_clear( struct page_table *pt, int release )
+{
+	int i;
+
+	if(release) {
+		free(pt->page_bits);
+		free(pt->page_mapping);
+		return;
+	}
+	for(i=0;i<pt->npages;i++) pt->page_bits[i] = 0;
+}
+
+static int pt_init( struct page_table *pt )
+{
+	pt->page_bits = malloc(sizeof(int)*(size_t)pt->npages);
+	pt->page_mapping = malloc(sizeof(int)*(size_t)pt->npages);
+	if(!pt->page_bits || !pt->page_mapping) return -1;
+
+	pt_clear(pt,0);
+	return 0;
+}
+
+#endif
+
 static void internal_fault_handler( int signum, siginfo_t *info, void *context )
 {
 
@@ -41,10 +215,14 @@ static void internal_fault_handler( int signum, siginfo_t *info, void *context )
 	struct page_table *pt = the_page_table;
 
 	if(pt) {
-		int page = (addr-pt->virtmem) / PAGE_SIZE;
+		long page = (addr-pt->virtmem) / PAGE_SIZE;
 
 		if(page>=0 && page<pt->npages) {
-			pt->handler(pt,page);
+			if(pt->access_handler) {
+				pt->access_handler(pt,page,fault_access(context));
+			} else {
+				pt->handler(pt,page);
+			}
 			return;
 		}
 	}
@@ -53,9 +231,8 @@ static void internal_fault_handler( int signum, siginfo_t *info, void *context )
 	abort();
 }
 
-struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler )
+static struct page_table * page_table_create_internal( int npages, int nframes, page_fault_handler_t handler, page_fault_access_handler_t access_handler )
 {
-	int i;
 	struct sigaction sa;
 	struct page_table *pt;
 	char filename[256];
@@ -70,22 +247,22 @@ struct page_table * page_table_create( int npages, int nframes, page_fault_handl
 	pt->fd = open(filename,O_CREAT|O_TRUNC|O_RDWR,0777);
 	if(!pt->fd) return 0;
 
-	ftruncate(pt->fd,PAGE_SIZE*npages);
+	ftruncate(pt->fd,(off_t)PAGE_SIZE*npages);
 
 	unlink(filename);
 
-	pt->physmem = mmap(0,nframes*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,pt->fd,0);
+	pt->physmem = mmap(0,(size_t)nframes*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,pt->fd,0);
 	pt->nframes = nframes;
 
-	pt->virtmem = mmap(0,npages*PAGE_SIZE,PROT_NONE,MAP_SHARED|MAP_NORESERVE,pt->fd,0);
+	pt->virtmem = mmap(0,(size_t)npages*PAGE_SIZE,PROT_NONE,MAP_SHARED|MAP_NORESERVE,pt->fd,0);
 	pt->npages = npages;
 
-	pt->page_bits = malloc(sizeof(int)*npages);
-	pt->page_mapping = malloc(sizeof(int)*npages);
+	if(pt_init(pt)<0) return 0;
 
 	pt->handler = handler;
-
-	for(i=0;i<pt->npages;i++) pt->page_bits[i] = 0;
+	pt->access_handler = access_handler;
+	pt->advice_handler = 0;
+	pt->backed = 0;
 
 	sa.sa_sigaction = internal_fault_handler;
 	sa.sa_flags = SA_SIGINFO;
@@ -96,12 +273,21 @@ struct page_table * page_table_create( int npages, int nframes, page_fault_handl
 	return pt;
 }
 
+struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler )
+{
+	return page_table_create_internal(npages,nframes,handler,0);
+}
+
+struct page_table * page_table_create_access( int npages, int nframes, page_fault_access_handler_t handler )
+{
+	return page_table_create_internal(npages,nframes,0,handler);
+}
+
 void page_table_delete( struct page_table *pt )
 {
-	munmap(pt->virtmem,pt->npages*PAGE_SIZE);
-	munmap(pt->physmem,pt->nframes*PAGE_SIZE);
-	free(pt->page_bits);
-	free(pt->page_mapping);
+	munmap(pt->virtmem,(size_t)pt->npages*PAGE_SIZE);
+	munmap(pt->physmem,(size_t)pt->nframes*PAGE_SIZE);
+	pt_clear(pt,1);
 	close(pt->fd);
 	free(pt);
 }
@@ -118,11 +304,28 @@ void page_table_set_entry( struct page_table *pt, int page, int frame, int bits
 		abort();
 	}
 
-	pt->page_mapping[page] = frame;
-	pt->page_bits[page] = bits;
+	pt_store(pt,page,frame,bits);
+
+	if(pt->backed) {
+		mprotect(pt->virtmem+(size_t)page*PAGE_SIZE,PAGE_SIZE,bits);
+		if(!bits) madvise(pt->virtmem+(size_t)page*PAGE_SIZE,PAGE_SIZE,MADV_DONTNEED);
+		return;
+	}
+
+	remap_file_pages(pt->virtmem+(size_t)page*PAGE_SIZE,PAGE_SIZE,0,frame,0);
+	mprotect(pt->virtmem+(size_t)page*PAGE_SIZE,PAGE_SIZE,bits);
+}
 
-	remap_file_pages(pt->virtmem+page*PAGE_SIZE,PAGE_SIZE,0,frame,0);
-	mprotect(pt->virtmem+page*PAGE_SIZE,PAGE_SIZE,bits);
+int page_table_set_backing( struct page_table *pt, int fd )
+{
+	char *mem;
+
+	mem = mmap(pt->virtmem,(size_t)pt->npages*PAGE_SIZE,PROT_NONE,MAP_SHARED|MAP_FIXED|MAP_NORESERVE,fd,0);
+	if(mem==MAP_FAILED) return -1;
+
+	pt->backed = 1;
+	pt_clear(pt,0);
+	return 0;
 }
 
 void page_table_get_entry( struct page_table *pt, int page, int *frame, int *bits )
@@ -133,8 +336,7 @@ void page_table_get_entry( struct page_table *pt, int page, int *frame, int *bit
 		abort();
 	}
 
-	*frame = pt->page_mapping[page];
-	*bits = pt->page_bits[page];
+	pt_load(pt,page,frame,bits);
     
 }
 
@@ -145,11 +347,12 @@ void page_table_print_entry( struct page_table *pt, int page )
 		abort();
 	}
 
-	int b = pt->page_bits[page];
+	int f, b;
+	pt_load(pt,page,&f,&b);
 
 	printf("page %06d: frame %06d bits %c%c%c\n",
 		page,
-		pt->page_mapping[page],
+		f,
 		b&PROT_READ  ? 'r' : '-',
 		b&PROT_WRITE ? 'w' : '-',
 		b&PROT_EXEC  ? 'x' : '-'
@@ -175,6 +378,43 @@ int page_table_get_npages( struct page_table *pt )
 	return pt->npages;
 }
 
+void page_table_set_advice_handler( struct page_table *pt, page_advice_handler_t handler )
+{
+	pt->advice_handler = handler;
+}
+
+int page_table_madvise( void *addr, size_t length, int advice )
+{
+	struct page_table *pt = the_page_table;
+	size_t offset, size;
+	long first, last;
+
+	if(!pt || advice<PAGE_ADVICE_NORMAL || advice>PAGE_ADVICE_UNPIN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size = (size_t)pt->npages*PAGE_SIZE;
+	offset = (char*)addr - pt->virtmem;
+	if((char*)addr<pt->virtmem || offset>size || length>size-offset) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(!pt->advice_handler) return 0;
+
+	if(advice==PAGE_ADVICE_DONTNEED || advice==PAGE_ADVICE_NOREAD) {
+		first = (offset + PAGE_SIZE - 1) / PAGE_SIZE;
+		last = (offset + length) / PAGE_SIZE;
+	} else {
+		first = offset / PAGE_SIZE;
+		last = (offset + length + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+
+	if(first<last) pt->advice_handler(pt,first,last-first,advice);
+	return 0;
+}
+
 char * page_table_get_virtmem( struct page_table *pt )
 {
 	return pt->virtmem;
@@ -7,16 +7,59 @@
 #define PAGE_SIZE 4096
 #endif
 
+/*
+A page table maps the pages of a virtual memory region onto the frames
+of a physical memory region. Touching a page that is not mapped with
+enough protection calls the page fault handler given at creation.
+*/
+
 struct page_table;
 
 typedef void (*page_fault_handler_t) ( struct page_table *pt, int page );
 
+/*
+Kinds of access that caused a fault, as passed to a page_fault_access_handler_t.
+PAGE_ACCESS_UNKNOWN is used on platforms where the fault does not say.
+*/
+
+#define PAGE_ACCESS_UNKNOWN 0
+#define PAGE_ACCESS_READ    1
+#define PAGE_ACCESS_WRITE   2
+
+typedef void (*page_fault_access_handler_t) ( struct page_table *pt, int page, int access );
+
+/*
+Advice a program may give about a range of its virtual memory with
+page_table_madvise, as passed to a page_advice_handler_t.
+PAGE_ADVICE_NORMAL     no special treatment; undoes PAGE_ADVICE_SEQUENTIAL
+PAGE_ADVICE_SEQUENTIAL the range will be read once in ascending order
+PAGE_ADVICE_WILLNEED   the range will be used soon and may be read in now
+PAGE_ADVICE_DONTNEED   the contents of the range are no longer needed
+PAGE_ADVICE_NOREAD     the range is about to be completely overwritten
+PAGE_ADVICE_PIN        keep the range resident
+PAGE_ADVICE_UNPIN      undo PAGE_ADVICE_PIN
+*/
+
+#define PAGE_ADVICE_NORMAL     0
+#define PAGE_ADVICE_SEQUENTIAL 1
+#define PAGE_ADVICE_WILLNEED   2
+#define PAGE_ADVICE_DONTNEED   3
+#define PAGE_ADVICE_NOREAD     4
+#define PAGE_ADVICE_PIN        5
+#define PAGE_ADVICE_UNPIN      6
+
+typedef void (*page_advice_handler_t) ( struct page_table *pt, int page, int npages, int advice );
+
 /* Create a new page table, along with a corresponding virtual memory
 that is "npages" big and a physical memory that is "nframes" bit
  When a page fault occurs, the routine pointed to by "handler" will be called. */
 
 struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler );
 
+/* Like page_table_create, but the handler is also told whether the fault was a read or a write (PAGE_ACCESS_*). */
+
+struct page_table * page_table_create_access( int npages, int nframes, page_fault_access_handler_t handler );
+
 /* Delete a page table and the corresponding virtual and physical memories. */
 
 void page_table_delete( struct page_table *pt );
@@ -36,6 +79,31 @@ The bits may be any of PROT_READ, PROT_WRITE, or PROT_EXEC logical-ored together
 
 void page_table_get_entry( struct page_table *pt, int page, int *frame, int *bits );
 
+/*
+Back the virtual memory with the file "fd" instead of the physical memory:
+page N becomes a window onto bytes N*PAGE_SIZE onward of the file, and
+page_table_set_entry only changes the protection of the page ("frame"
+is kept for bookkeeping).  Clearing all bits also drops the page from
+the process, so the file's page cache is the only copy of its data.
+All entries are reset.  Returns 0 on success or -1 on failure.
+*/
+
+int page_table_set_backing( struct page_table *pt, int fd );
+
+/* Call "handler" with the advice given through page_table_madvise. Without a handler advice is ignored. */
+
+void page_table_set_advice_handler( struct page_table *pt, page_advice_handler_t handler );
+
+/*
+Give PAGE_ADVICE_* advice about "length" bytes of virtual memory starting
+at "addr", which may be anywhere in the current page table's virtual memory.
+DONTNEED and NOREAD apply only to pages that lie wholly inside the range,
+and other advice applies to every page the range touches.
+Returns 0 on success, or -1 if the range or the advice is invalid.
+*/
+
+int page_table_madvise( void *addr, size_t length, int advice );
+
 /* Return a pointer to the start of the virtual memory associated with a page table. */
 
 char * page_table_get_virtmem( struct page_table *pt );
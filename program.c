@@ -1,13 +1,27 @@
 /*
-Do not modify this file.
-Make all of your changes to main.c instead.
+The scan, sort and focus test programs and their hinted variants.
+Each program reports a checkpoint once its data is filled in, so that
+the fork server can snapshot the state before the measured part.
 */
 
 #include "program.h"
+#include "page_table.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+static program_checkpoint_t checkpoint_hook = 0;
+
+void program_set_checkpoint( program_checkpoint_t hook )
+{
+	checkpoint_hook = hook;
+}
+
+void program_checkpoint( const char *name )
+{
+	if(checkpoint_hook) checkpoint_hook(name);
+}
+
 static int compare_bytes( const void *pa, const void *pb )
 {
 	int a = *(char*)pa;
@@ -23,10 +37,11 @@ static int compare_bytes( const void *pa, const void *pb )
 
 }
 
-void focus_program( char *data, int length )
+void focus_program( char *data, long length )
 {
 	int total=0;
-	int i,j;
+	long i;
+	int j;
 
 	srand48(38290);
 
@@ -34,8 +49,10 @@ void focus_program( char *data, int length )
 		data[i] = 0;
 	}
 
+	program_checkpoint("fill");
+
 	for(j=0;j<100;j++) {
-		int start = lrand48()%length;
+		long start = lrand48()%length;
 		int size = 25;
 		for(i=0;i<100;i++) {
 			data[ (start+lrand48()%size)%length ] = lrand48();
@@ -49,10 +66,10 @@ void focus_program( char *data, int length )
 	printf("focus result is %d\n",total);
 }
 
-void sort_program( char *data, int length )
+void sort_program( char *data, long length )
 {
 	int total = 0;
-	int i;
+	long i;
 
 	srand48(4856);
 
@@ -60,8 +77,12 @@ void sort_program( char *data, int length )
 		data[i] = lrand48();
 	}
 
+	program_checkpoint("fill");
+
 	qsort(data,length,1,compare_bytes);
 
+	program_checkpoint("sort");
+
 	for(i=0;i<length;i++) {
 		total += data[i];
 	}
@@ -70,9 +91,10 @@ void sort_program( char *data, int length )
 
 }
 
-void scan_program( char *cdata, int length )
+void scan_program( char *cdata, long length )
 {
-	unsigned i, j;
+	unsigned long i;
+	unsigned j;
 	unsigned char *data = (unsigned char*) cdata;
 	unsigned total = 0;
 
@@ -80,6 +102,8 @@ void scan_program( char *cdata, int length )
 		data[i] = i%256;
 	}
 
+	program_checkpoint("fill");
+
 	for(j=0;j<10;j++) {
 		for(i=0;i<length;i++) {
 			total += data[i];
@@ -87,4 +111,114 @@ void scan_program( char *cdata, int length )
 	}
 
 	printf("scan result is %d\n",total);
-}
\ No newline at end of file
+}
+
+/*
+The hinted programs do the same work and print the same results as the
+programs above, but tell the pager what they are about to do with
+page_table_madvise.
+*/
+
+#define HINT_CHUNK (16*PAGE_SIZE)
+
+/* Sum a final pass over the data, discarding each chunk once it has been read. */
+
+static int sum_and_discard( char *data, long length )
+{
+	int total = 0;
+	long i, chunk;
+
+	page_table_madvise(data,length,PAGE_ADVICE_SEQUENTIAL);
+
+	for(chunk=0;chunk<length;chunk+=HINT_CHUNK) {
+		long end = chunk+HINT_CHUNK<length ? chunk+HINT_CHUNK : length;
+		for(i=chunk;i<end;i++) {
+			total += data[i];
+		}
+		page_table_madvise(data+chunk,end-chunk,PAGE_ADVICE_DONTNEED);
+	}
+
+	return total;
+}
+
+void focus_hinted_program( char *data, long length )
+{
+	int total=0;
+	long i;
+	int j;
+
+	srand48(38290);
+
+	page_table_madvise(data,length,PAGE_ADVICE_NOREAD);
+
+	for(i=0;i<length;i++) {
+		data[i] = 0;
+	}
+
+	program_checkpoint("fill");
+
+	for(j=0;j<100;j++) {
+		long start = lrand48()%length;
+		int size = 25;
+		page_table_madvise(data+start,start+size<=length ? size : length-start,PAGE_ADVICE_WILLNEED);
+		for(i=0;i<100;i++) {
+			data[ (start+lrand48()%size)%length ] = lrand48();
+		}
+	}
+
+	total = sum_and_discard(data,length);
+
+	printf("focus result is %d\n",total);
+}
+
+void sort_hinted_program( char *data, long length )
+{
+	int total = 0;
+	long i;
+
+	srand48(4856);
+
+	page_table_madvise(data,length,PAGE_ADVICE_NOREAD);
+
+	for(i=0;i<length;i++) {
+		data[i] = lrand48();
+	}
+
+	program_checkpoint("fill");
+
+	qsort(data,length,1,compare_bytes);
+
+	program_checkpoint("sort");
+
+	total = sum_and_discard(data,length);
+
+	printf("sort result is %d\n",total);
+}
+
+void scan_hinted_program( char *cdata, long length )
+{
+	unsigned long i;
+	unsigned j;
+	unsigned char *data = (unsigned char*) cdata;
+	unsigned total = 0;
+
+	page_table_madvise(cdata,length,PAGE_ADVICE_NOREAD);
+
+	for(i=0;i<length;i++) {
+		data[i] = i%256;
+	}
+
+	program_checkpoint("fill");
+
+	/* Every pass loops over all of the data: keep what fits resident and stream the rest. */
+	page_table_madvise(cdata,length,PAGE_ADVICE_PIN);
+	page_table_madvise(cdata,length,PAGE_ADVICE_SEQUENTIAL);
+
+	for(j=0;j<10;j++) {
+		for(i=0;i<length;i++) {
+			total += data[i];
+		}
+	}
+
+	printf("scan result is %d\n",total);
+}
@@ -1,13 +1,34 @@
 /*
-Do not modify this file.
-Make all of your changes to main.c instead.
+The built-in test programs that run over the virtual memory region:
+scan, sort and focus, and hinted variants of each that tell the pager
+about their access pattern with page_table_madvise.
 */
 
 #ifndef PROGRAM_H
 #define PROGRAM_H
 
-void scan_program( char *data, int length );
-void sort_program( char *data, int length );
-void focus_program( char *data, int length );
+/*
+A checkpoint hook is called with a name at fixed points of each program,
+such as "fill" once its data has been initialized.  The default is to
+do nothing.
+*/
+
+typedef void (*program_checkpoint_t)( const char *name );
+
+void program_set_checkpoint( program_checkpoint_t hook );
+void program_checkpoint( const char *name );
+
+void scan_program( char *data, long length );
+void sort_program( char *data, long length );
+void focus_program( char *data, long length );
+
+/*
+Hinted variants of the programs above: the same work and results, with
+page_table_madvise hints about what each phase is about to do.
+*/
+
+void scan_hinted_program( char *data, long length );
+void sort_hinted_program( char *data, long length );
+void focus_hinted_program( char *data, long length );
 
 #endif
\ No newline at end of file
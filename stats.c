@@ -0,0 +1,90 @@
+/*
+Shared memory segment holding the live statistics of a virtmem run.
+*/
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+void stats_name( int pid, char *name, int length )
+{
+	snprintf(name,length,"/virtmem.%d",pid);
+}
+
+struct virtmem_stats * stats_create( void )
+{
+	struct virtmem_stats *s;
+	char name[64];
+	int fd;
+
+	stats_name(getpid(),name,sizeof(name));
+	fd = shm_open(name,O_CREAT|O_RDWR|O_TRUNC,0644);
+	if(fd<0) return 0;
+
+	if(ftruncate(fd,sizeof(*s))<0) {
+		close(fd);
+		shm_unlink(name);
+		return 0;
+	}
+
+	s = mmap(0,sizeof(*s),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if(s==MAP_FAILED) {
+		shm_unlink(name);
+		return 0;
+	}
+
+	memset(s,0,sizeof(*s));
+	s->pid = getpid();
+	s->version = STATS_VERSION;
+	__atomic_store_n(&s->magic,STATS_MAGIC,__ATOMIC_RELEASE);
+	return s;
+}
+
+const struct virtmem_stats * stats_attach( int pid )
+{
+	struct virtmem_stats *s;
+	char name[64];
+	int fd;
+
+	stats_name(pid,name,sizeof(name));
+	fd = shm_open(name,O_RDONLY,0);
+	if(fd<0) return 0;
+
+	s = mmap(0,sizeof(*s),PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(s==MAP_FAILED) return 0;
+
+	if(__atomic_load_n(&s->magic,__ATOMIC_ACQUIRE)!=STATS_MAGIC || s->version!=STATS_VERSION) {
+		munmap(s,sizeof(*s));
+		return 0;
+	}
+	return s;
+}
+
+void stats_close( const struct virtmem_stats *s, int owner )
+{
+	char name[64];
+
+	if(owner) {
+		stats_name(s->pid,name,sizeof(name));
+		shm_unlink(name);
+	}
+	munmap((void*)s,sizeof(*s));
+}
+
+void stats_read( const struct virtmem_stats *s, struct virtmem_stats *copy )
+{
+	unsigned long long before, after;
+
+	do {
+		before = __atomic_load_n(&s->seq,__ATOMIC_ACQUIRE);
+		memcpy(copy,(const void*)s,sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&s->seq,__ATOMIC_RELAXED);
+	} while((before&1) || before!=after);
+}
@@ -0,0 +1,83 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+Live statistics published by a running virtmem in the POSIX shared
+memory object "/virtmem.<pid>", and read by virtmem-top.
+
+The writer brackets every update with stats_write_begin/stats_write_end,
+which make the sequence number odd while the update is in progress.
+Readers copy the whole segment with stats_read and retry until they see
+the same even sequence number before and after the copy, so they never
+observe a half-written update and the writer never blocks or makes a
+system call.
+*/
+
+#define STATS_MAGIC 0x53544d56 /* "VMTS" */
+#define STATS_VERSION 1
+#define STATS_WINDOW 60 /* seconds of per-second fault counts kept */
+
+struct virtmem_stats {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long seq;
+
+	int pid;
+	int npages;
+	int nframes;
+	int finished;
+	char policy[16];
+	char program[32];
+
+	long long page_faults;
+	long long disk_reads;
+	long long disk_writes;
+	long long bytes_written;
+	int frames_used;
+	int frames_dirty;
+
+	/* Faults in each of the last STATS_WINDOW seconds of CLOCK_MONOTONIC,
+	   bucket i holding second bucket_sec[i] */
+	long long start_sec;
+	long long bucket_sec[STATS_WINDOW];
+	long long bucket_faults[STATS_WINDOW];
+};
+
+/* Write the shared memory name used by process "pid" into "name". */
+
+void stats_name( int pid, char *name, int length );
+
+/*
+Create and map the stats segment for this process.
+Returns a pointer to the zeroed segment, or null on failure.
+*/
+
+struct virtmem_stats * stats_create( void );
+
+/*
+Map the stats segment of process "pid" read-only.
+Returns a pointer to the segment, or null on failure.
+*/
+
+const struct virtmem_stats * stats_attach( int pid );
+
+/* Unmap a segment; "owner" also removes the shared memory object. */
+
+void stats_close( const struct virtmem_stats *s, int owner );
+
+/* Copy a consistent snapshot of "s" into "copy". */
+
+void stats_read( const struct virtmem_stats *s, struct virtmem_stats *copy );
+
+static inline void stats_write_begin( struct virtmem_stats *s )
+{
+	__atomic_store_n(&s->seq,s->seq+1,__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void stats_write_end( struct virtmem_stats *s )
+{
+	__atomic_store_n(&s->seq,s->seq+1,__ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,286 @@
+/*
+Streaming reader, converter and replayer for memory-access traces.
+The whole file is mapped read-only and parsed in place, so traces much
+larger than memory stream through the page cache.
+*/
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_ADDR_MASK  0x00ffffffffffffffULL
+#define TRACE_SIZE_SHIFT 56
+#define TRACE_WRITE_BIT  0x8000000000000000ULL
+
+struct trace_reader {
+	int fd;
+	char *map;
+	size_t size;
+	size_t pos;
+	int format;
+	int have_min;
+	unsigned long long min_addr;
+	int have_store;		/* the store half of a lackey M is still to come */
+	struct trace_access store;
+};
+
+struct trace_reader * trace_open( const char *filename )
+{
+	struct trace_reader *t;
+	struct stat info;
+
+	t = calloc(1,sizeof(*t));
+	if(!t) return 0;
+
+	t->fd = open(filename,O_RDONLY);
+	if(t->fd<0 || fstat(t->fd,&info)<0) {
+		if(t->fd>=0) close(t->fd);
+		free(t);
+		return 0;
+	}
+
+	t->size = info.st_size;
+	if(t->size>0) {
+		t->map = mmap(0,t->size,PROT_READ,MAP_PRIVATE,t->fd,0);
+		if(t->map==MAP_FAILED) {
+			close(t->fd);
+			free(t);
+			return 0;
+		}
+		madvise(t->map,t->size,MADV_SEQUENTIAL);
+	}
+
+	if(t->size>=sizeof(struct trace_header) && ((struct trace_header*)t->map)->magic==TRACE_MAGIC) {
+		t->format = TRACE_FORMAT_BINARY;
+		t->min_addr = ((struct trace_header*)t->map)->min_addr;
+		t->have_min = 1;
+	} else {
+		t->format = TRACE_FORMAT_LACKEY;
+	}
+
+	trace_rewind(t);
+	return t;
+}
+
+int trace_format( struct trace_reader *t )
+{
+	return t->format;
+}
+
+void trace_rewind( struct trace_reader *t )
+{
+	t->pos = t->format==TRACE_FORMAT_BINARY ? sizeof(struct trace_header) : 0;
+	t->have_store = 0;
+}
+
+static inline int hex_digit( char c )
+{
+	if(c>='0' && c<='9') return c-'0';
+	if(c>='a' && c<='f') return c-'a'+10;
+	if(c>='A' && c<='F') return c-'A'+10;
+	return -1;
+}
+
+/*
+Parse one lackey line starting at t->pos; returns 1 if it held a data access.
+A modify (M) is a load followed by a store to the same bytes, so it is
+returned as a load and the store is handed out by the next call.
+*/
+
+static int trace_next_lackey( struct trace_reader *t, struct trace_access *a )
+{
+	const char *p, *end = t->map + t->size;
+	const char *line;
+	char type;
+	int digit;
+
+	if(t->have_store) {
+		*a = t->store;
+		t->have_store = 0;
+		return 1;
+	}
+
+	while(t->pos<t->size) {
+		line = p = t->map + t->pos;
+		while(p<end && *p!='\n') p++;
+		t->pos = (p - t->map) + 1;
+
+		/* Lines look like " L 0421c4a0,4"; anything else is skipped. */
+		while(line<p && *line==' ') line++;
+		if(line>=p) continue;
+		type = *line++;
+		if(type!='L' && type!='S' && type!='M') continue;
+		while(line<p && *line==' ') line++;
+
+		a->addr = 0;
+		while(line<p && (digit = hex_digit(*line))>=0) {
+			a->addr = (a->addr<<4) | digit;
+			line++;
+		}
+		a->size = 1;
+		if(line<p && *line==',') {
+			a->size = atoi(line+1);
+			if(a->size<1) a->size = 1;
+		}
+		a->write = (type=='S');
+		if(type=='M') {
+			t->store = *a;
+			t->store.write = 1;
+			t->have_store = 1;
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+int trace_next( struct trace_reader *t, struct trace_access *a )
+{
+	if(t->format==TRACE_FORMAT_BINARY) {
+		unsigned long long record;
+
+		if(t->pos+sizeof(record)>t->size) return 0;
+		memcpy(&record,t->map+t->pos,sizeof(record));
+		t->pos += sizeof(record);
+
+		a->addr = record & TRACE_ADDR_MASK;
+		a->size = (int)((record >> TRACE_SIZE_SHIFT) & 0x7f);
+		a->write = (record & TRACE_WRITE_BIT) != 0;
+		return 1;
+	}
+
+	return trace_next_lackey(t,a);
+}
+
+unsigned long long trace_min_addr( struct trace_reader *t )
+{
+	struct trace_access a, store;
+	size_t pos;
+	int have_store;
+
+	if(t->have_min) return t->min_addr;
+
+	pos = t->pos;
+	have_store = t->have_store;
+	store = t->store;
+	trace_rewind(t);
+	t->min_addr = ~0ULL;
+	while(trace_next(t,&a)) {
+		if(a.addr<t->min_addr) t->min_addr = a.addr;
+	}
+	if(t->min_addr==~0ULL) t->min_addr = 0;
+	t->have_min = 1;
+	t->pos = pos;
+	t->have_store = have_store;
+	t->store = store;
+
+	return t->min_addr;
+}
+
+void trace_close( struct trace_reader *t )
+{
+	if(t->map) munmap(t->map,t->size);
+	close(t->fd);
+	free(t);
+}
+
+long trace_convert( const char *in, const char *out )
+{
+	struct trace_reader *t;
+	struct trace_access a;
+	struct trace_header header;
+	FILE *file;
+	long count = 0;
+
+	t = trace_open(in);
+	if(!t) return -1;
+
+	file = fopen(out,"w");
+	if(!file) {
+		trace_close(t);
+		return -1;
+	}
+
+	if(t->format==TRACE_FORMAT_LACKEY) {
+		/* Leave room for the header and fill it in once the extent is known. */
+		memset(&header,0,sizeof(header));
+		header.magic = TRACE_MAGIC;
+		header.version = 1;
+		header.min_addr = ~0ULL;
+		fwrite(&header,sizeof(header),1,file);
+
+		while(trace_next(t,&a)) {
+			unsigned long long size = a.size>0x7f ? 0x7f : a.size;
+			unsigned long long record = (a.addr & TRACE_ADDR_MASK) | (size << TRACE_SIZE_SHIFT);
+			if(a.write) record |= TRACE_WRITE_BIT;
+			fwrite(&record,sizeof(record),1,file);
+
+			if(a.addr<header.min_addr) header.min_addr = a.addr;
+			if(a.addr>header.max_addr) header.max_addr = a.addr;
+			count++;
+		}
+
+		if(!count) header.min_addr = 0;
+		header.count = count;
+		fseek(file,0,SEEK_SET);
+		fwrite(&header,sizeof(header),1,file);
+	} else {
+		while(trace_next(t,&a)) {
+			fprintf(file," %c %08llx,%d\n",a.write ? 'S' : 'L',a.addr,a.size);
+			count++;
+		}
+	}
+
+	if(fclose(file)!=0) count = -1;
+	trace_close(t);
+	return count;
+}
+
+void trace_program( char *data, long length, const char *filename )
+{
+	struct trace_reader *t;
+	struct trace_access a;
+	unsigned long long base;
+	long first, last, count = 0;
+	int total = 0;
+
+	if(!filename) {
+		fprintf(stderr,"trace: no trace file given (use trace=FILE)\n");
+		exit(1);
+	}
+
+	t = trace_open(filename);
+	if(!t) {
+		fprintf(stderr,"trace: couldn't open %s\n",filename);
+		exit(1);
+	}
+
+	base = trace_min_addr(t);
+
+	/*
+	Touch the first and last byte of each access, so one that straddles
+	a page boundary faults on both pages.
+	*/
+	while(trace_next(t,&a)) {
+		first = (long)((a.addr - base) % (unsigned long long)length);
+		last = (long)((a.addr + (a.size>1 ? a.size-1 : 0) - base) % (unsigned long long)length);
+		if(a.write) {
+			data[first] = (char)a.addr;
+			data[last] = (char)a.addr;
+		} else {
+			total += data[first];
+			if(last!=first) total += data[last];
+		}
+		count++;
+	}
+
+	trace_close(t);
+
+	printf("trace result is %d (%ld accesses)\n",total,count);
+}
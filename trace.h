@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+Memory-access traces, read through a read-only mapping of the file.
+Two formats are understood:
+
+TRACE_FORMAT_LACKEY  text from "valgrind --tool=lackey --trace-mem=yes",
+                     lines of the form " L 0421c4a0,4" (L load, S store,
+                     M modify, I instruction fetch, which is skipped).
+                     A modify is read as a load followed by a store.
+TRACE_FORMAT_BINARY  a struct trace_header followed by one 64-bit record
+                     per access: address in bits 0-55, size in bits 56-62
+                     and bit 63 set for stores.
+*/
+
+#define TRACE_FORMAT_LACKEY 0
+#define TRACE_FORMAT_BINARY 1
+
+#define TRACE_MAGIC 0x42544d56 /* "VMTB" */
+
+struct trace_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long count;
+	unsigned long long min_addr;
+	unsigned long long max_addr;
+};
+
+struct trace_access {
+	unsigned long long addr;
+	int size;
+	int write;
+};
+
+struct trace_reader;
+
+/*
+Open a trace file and detect its format.
+Returns a pointer to a new reader, or null on failure.
+*/
+
+struct trace_reader * trace_open( const char *filename );
+
+/* Return the TRACE_FORMAT_* of an open trace. */
+
+int trace_format( struct trace_reader *t );
+
+/*
+Store the next access in "a".
+Returns 1 if an access was read, or 0 at the end of the trace.
+*/
+
+int trace_next( struct trace_reader *t, struct trace_access *a );
+
+/* Go back to the first access. */
+
+void trace_rewind( struct trace_reader *t );
+
+/*
+Return the lowest address in the trace.
+Binary traces record it in the header; text traces are scanned once.
+*/
+
+unsigned long long trace_min_addr( struct trace_reader *t );
+
+/* Close a trace and release its mapping. */
+
+void trace_close( struct trace_reader *t );
+
+/*
+Convert "in" to the other format and write it to "out".
+Returns the number of accesses written, or -1 on failure.
+*/
+
+long trace_convert( const char *in, const char *out );
+
+/*
+Replay every load and store of the trace at "filename" against "data".
+Addresses are rebased to the lowest one in the trace and folded into
+"length" bytes, which keeps their offsets within a page.  Each access
+touches its first and last byte, so one that crosses a page touches both.
+*/
+
+void trace_program( char *data, long length, const char *filename );
+
+#endif
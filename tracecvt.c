@@ -0,0 +1,31 @@
+/*
+Convert a memory-access trace between Valgrind lackey text and the
+compact binary format replayed by "virtmem ... trace trace=FILE".
+The direction is picked from the input: text becomes binary and
+binary becomes text.
+*/
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+int main( int argc, char *argv[] )
+{
+	long count;
+
+	if(argc!=3) {
+		printf("use: tracecvt <input trace> <output trace>\n");
+		return 1;
+	}
+
+	count = trace_convert(argv[1],argv[2]);
+	if(count<0) {
+		fprintf(stderr,"couldn't convert %s to %s: %s\n",argv[1],argv[2],strerror(errno));
+		return 1;
+	}
+
+	printf("converted %ld accesses\n",count);
+	return 0;
+}
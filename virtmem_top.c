@@ -0,0 +1,116 @@
+/*
+Attach to the live statistics of a running "virtmem ... stats=1" and
+print its fault rate, I/O counters and frame occupancy once a second.
+Without a pid the most recently started run is used.
+*/
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static int find_newest_run( void )
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat info;
+	char path[300];
+	time_t newest = 0;
+	int pid = 0;
+
+	dir = opendir("/dev/shm");
+	if(!dir) return 0;
+
+	while((entry = readdir(dir))) {
+		if(strncmp(entry->d_name,"virtmem.",8)) continue;
+		snprintf(path,sizeof(path),"/dev/shm/%s",entry->d_name);
+		if(stat(path,&info)<0) continue;
+		if(!pid || info.st_mtime>=newest) {
+			newest = info.st_mtime;
+			pid = atoi(entry->d_name+8);
+		}
+	}
+
+	closedir(dir);
+	return pid;
+}
+
+static long long now_sec( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+	return ts.tv_sec;
+}
+
+static long long faults_in_second( const struct virtmem_stats *s, long long sec )
+{
+	int i = sec % STATS_WINDOW;
+	return s->bucket_sec[i]==sec ? s->bucket_faults[i] : 0;
+}
+
+static void show( const struct virtmem_stats *s )
+{
+	long long now = now_sec();
+	long long sec, total = 0;
+	long long seconds = now - s->start_sec;
+
+	if(seconds>STATS_WINDOW-1) seconds = STATS_WINDOW-1;
+	for(sec=now-seconds;sec<now;sec++) {
+		total += faults_in_second(s,sec);
+	}
+
+	printf("%d %s/%s  faults %lld  %lld/s (avg %lld/s over %llds)  reads %lld  writes %lld  written %lld KB  frames %d/%d  dirty %.1f%%%s\n",
+		s->pid,s->policy,s->program,
+		s->page_faults,
+		faults_in_second(s,now-1),
+		seconds>0 ? total/seconds : 0,seconds,
+		s->disk_reads,s->disk_writes,s->bytes_written/1024,
+		s->frames_used,s->nframes,
+		s->frames_used ? 100.0*s->frames_dirty/s->frames_used : 0.0,
+		s->finished ? "  finished" : "");
+	fflush(stdout);
+}
+
+int main( int argc, char *argv[] )
+{
+	const struct virtmem_stats *s;
+	struct virtmem_stats copy;
+	int pid, interval = 1;
+
+	if(argc>3) {
+		printf("use: virtmem-top [pid] [interval seconds]\n");
+		return 1;
+	}
+
+	pid = argc>1 ? atoi(argv[1]) : find_newest_run();
+	if(argc>2) interval = atoi(argv[2]);
+	if(interval<1) interval = 1;
+
+	if(!pid) {
+		fprintf(stderr,"virtmem-top: no running virtmem with stats=1 found\n");
+		return 1;
+	}
+
+	s = stats_attach(pid);
+	if(!s) {
+		fprintf(stderr,"virtmem-top: couldn't attach to virtmem %d: %s\n",pid,strerror(errno));
+		return 1;
+	}
+
+	for(;;) {
+		stats_read(s,&copy);
+		show(&copy);
+		if(copy.finished || (kill(pid,0)<0 && errno==ESRCH)) break;
+		sleep(interval);
+	}
+
+	stats_close(s,0);
+	return 0;
+}
@@ -0,0 +1,467 @@
+/*
+Synthetic workload generators.
+Every workload touches the region with plain loads and stores so that
+the only overhead is the page fault path itself.
+*/
+
+#include "workload.h"
+#include "page_table.h"
+#include "program.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+xorshift64* generator; much cheaper than lrand48 so the workloads
+run at memory speed between faults.
+*/
+
+static unsigned long long rng_state;
+
+static void rng_seed( long seed )
+{
+	rng_state = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)seed;
+	if(!rng_state) rng_state = 1;
+}
+
+static inline unsigned long long rng_next()
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+static inline double rng_double()
+{
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+Zipfian rank generator from Gray et al., "Quickly Generating
+Billion-Record Synthetic Databases". Ranks are in [0,n).
+*/
+
+struct zipf {
+	long n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+};
+
+static void zipf_init( struct zipf *z, long n, double theta )
+{
+	long i;
+	double zeta2 = 1.0 + pow(0.5,theta);
+
+	z->n = n;
+	z->theta = theta;
+	z->alpha = 1.0 / (1.0 - theta);
+	z->zetan = 0;
+	for(i=1;i<=n;i++) {
+		z->zetan += 1.0 / pow((double)i,theta);
+	}
+	z->eta = (1.0 - pow(2.0/n,1.0-theta)) / (1.0 - zeta2/z->zetan);
+}
+
+static long zipf_next( struct zipf *z )
+{
+	double u = rng_double();
+	double uz = u * z->zetan;
+	long rank;
+
+	if(uz<1.0) return 0;
+	if(uz<1.0+pow(0.5,z->theta)) return 1;
+
+	rank = (long)(z->n * pow(z->eta*u - z->eta + 1.0,z->alpha));
+	if(rank>=z->n) rank = z->n-1;
+	return rank;
+}
+
+/*
+Scatter ranks over the region so that the hot pages are not all
+packed together at the start of memory.
+*/
+
+static inline long scatter( long rank, long n )
+{
+	return (long)(((unsigned long long)rank * 2654435761ULL) % (unsigned long long)n);
+}
+
+/* Load or store one byte of "page" at a random offset. */
+
+static inline void touch_page( char *data, long page, int write_pct, int *total )
+{
+	unsigned long long r = rng_next();
+	char *p = &data[page*PAGE_SIZE + (long)(r % PAGE_SIZE)];
+
+	if((int)((r >> 32) % 100) < write_pct) {
+		*p = (char)(r >> 24);
+	} else {
+		*total += *p;
+	}
+}
+
+static long default_ops( const struct workload_options *opts, long npages )
+{
+	return opts->ops > 0 ? opts->ops : 16*npages;
+}
+
+/* Zero the region first, as focus does, so results do not depend on stale disk contents. */
+
+static void fill_pages( char *data, long npages )
+{
+	long i;
+
+	for(i=0;i<npages*PAGE_SIZE;i++) {
+		data[i] = 0;
+	}
+
+	program_checkpoint("fill");
+}
+
+static int zipf_workload( char *data, long npages, const struct workload_options *opts )
+{
+	struct zipf z;
+	long i, ops = default_ops(opts,npages);
+	int total = 0;
+
+	fill_pages(data,npages);
+	zipf_init(&z,npages,opts->theta);
+
+	for(i=0;i<ops;i++) {
+		touch_page(data,scatter(zipf_next(&z),npages),opts->write_pct,&total);
+	}
+
+	return total;
+}
+
+static int uniform_workload( char *data, long npages, const struct workload_options *opts )
+{
+	long i, ops = default_ops(opts,npages);
+	int total = 0;
+
+	fill_pages(data,npages);
+
+	for(i=0;i<ops;i++) {
+		touch_page(data,(long)(rng_next() % npages),opts->write_pct,&total);
+	}
+
+	return total;
+}
+
+static int stride_workload( char *data, long length, const struct workload_options *opts )
+{
+	long i;
+	int j, total = 0;
+
+	for(j=0;j<opts->loops;j++) {
+		for(i=0;i<length;i+=opts->stride) {
+			if(j==0) {
+				data[i] = (char)(i/opts->stride);
+			} else {
+				total += data[i];
+			}
+		}
+		if(j==0) program_checkpoint("fill");
+	}
+
+	return total;
+}
+
+static int loop_workload( char *data, long length, const struct workload_options *opts )
+{
+	long i, span = length;
+	int j, total = 0;
+
+	if(opts->span>0 && (long)opts->span*PAGE_SIZE<length) {
+		span = (long)opts->span*PAGE_SIZE;
+	}
+
+	for(i=0;i<span;i++) {
+		data[i] = (char)(i%256);
+	}
+
+	program_checkpoint("fill");
+
+	for(j=0;j<opts->loops;j++) {
+		for(i=0;i<span;i++) {
+			total += data[i];
+		}
+	}
+
+	return total;
+}
+
+/*
+Pick the matmul dimension for a region of "length" bytes.
+Returns -1 if the requested dimension does not fit.
+*/
+
+static long matmul_dim( long length, const struct workload_options *opts )
+{
+	long n = opts->dim;
+
+	/* Three n x n matrices must fit; keep n^3 reasonable by default. */
+	if(n<=0) {
+		n = (long)sqrt((double)length / (3*sizeof(double)));
+		if(n>512) n = 512;
+	}
+	/* Divide rather than multiply so a huge dim cannot wrap the product. */
+	if(n>(long)(length/(3*sizeof(double)))/n) {
+		fprintf(stderr,"matmul: dim=%ld does not fit in %ld bytes\n",n,length);
+		return -1;
+	}
+	return n;
+}
+
+static int matmul_workload( char *data, long n, const struct workload_options *opts )
+{
+	double *a = (double*)data;
+	long bs = opts->block;
+	long i, j, k, ii, jj, kk;
+	double *b, *c, sum = 0;
+
+	if(bs<=0 || bs>n) bs = n;
+
+	b = a + n*n;
+	c = b + n*n;
+
+	for(i=0;i<n*n;i++) {
+		a[i] = (double)(rng_next() % 16);
+		b[i] = (double)(rng_next() % 16);
+		c[i] = 0;
+	}
+
+	program_checkpoint("fill");
+
+	for(ii=0;ii<n;ii+=bs) {
+		for(kk=0;kk<n;kk+=bs) {
+			for(jj=0;jj<n;jj+=bs) {
+				for(i=ii;i<ii+bs && i<n;i++) {
+					for(k=kk;k<kk+bs && k<n;k++) {
+						double aik = a[i*n+k];
+						for(j=jj;j<jj+bs && j<n;j++) {
+							c[i*n+j] += aik * b[k*n+j];
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for(i=0;i<n*n;i++) {
+		sum += c[i];
+	}
+
+	return (int)fmod(sum,2147483647.0);
+}
+
+/*
+Open-addressing hash table filling the whole region.
+The table is built to half occupancy and then probed, with roughly
+half of the probes hitting keys that were inserted.
+*/
+
+struct hash_slot {
+	unsigned long long key;
+	unsigned long long value;
+};
+
+static inline unsigned long long hash_key( unsigned long long k )
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static int hash_workload( char *data, long length, const struct workload_options *opts )
+{
+	struct hash_slot *table = (struct hash_slot*)data;
+	long nslots = length / sizeof(struct hash_slot);
+	long ninsert = nslots / 2;
+	long nprobe = opts->ops > 0 ? opts->ops : nslots;
+	long i, s, hits = 0;
+	unsigned long long key, sum = 0;
+
+	for(i=0;i<nslots;i++) {
+		table[i].key = 0;
+	}
+
+	program_checkpoint("fill");
+
+	for(i=0;i<ninsert;i++) {
+		key = 2*(unsigned long long)i + 2;
+		s = (long)(hash_key(key) % nslots);
+		while(table[s].key) {
+			s = (s+1) % nslots;
+		}
+		table[s].key = key;
+		table[s].value = rng_next();
+	}
+
+	program_checkpoint("build");
+
+	for(i=0;i<nprobe;i++) {
+		/* Even keys below 2*ninsert+2 are present, odd keys are not. */
+		key = (rng_next() % (2*(unsigned long long)ninsert)) + 2;
+		s = (long)(hash_key(key) % nslots);
+		while(table[s].key) {
+			if(table[s].key==key) {
+				hits++;
+				sum += table[s].value;
+				break;
+			}
+			s = (s+1) % nslots;
+		}
+	}
+
+	return (int)(hits + (sum & 0xffff));
+}
+
+/*
+Cycle through zipf, uniform and looping phases.
+Each phase also moves the hot set, so a policy has to adapt.
+*/
+
+static int phase_workload( char *data, long npages, const struct workload_options *opts )
+{
+	struct zipf z;
+	long ops = default_ops(opts,npages);
+	long per_phase = ops / opts->phases;
+	long i, base, span;
+	int p, total = 0;
+
+	fill_pages(data,npages);
+	zipf_init(&z,npages,opts->theta);
+
+	for(p=0;p<opts->phases;p++) {
+		base = (npages / opts->phases) * p;
+		switch(p%3) {
+		case 0:
+			for(i=0;i<per_phase;i++) {
+				touch_page(data,(base+scatter(zipf_next(&z),npages)) % npages,opts->write_pct,&total);
+			}
+			break;
+		case 1:
+			for(i=0;i<per_phase;i++) {
+				touch_page(data,(long)(rng_next() % npages),opts->write_pct,&total);
+			}
+			break;
+		case 2:
+			span = npages/2 > 0 ? npages/2 : 1;
+			for(i=0;i<per_phase;i++) {
+				touch_page(data,(base + i%span) % npages,opts->write_pct,&total);
+			}
+			break;
+		}
+	}
+
+	return total;
+}
+
+void workload_options_init( struct workload_options *opts )
+{
+	opts->theta = 0.99;
+	opts->ops = 0;
+	opts->write_pct = 30;
+	opts->stride = PAGE_SIZE;
+	opts->span = 0;
+	opts->loops = 10;
+	opts->dim = 0;
+	opts->block = 32;
+	opts->phases = 4;
+	opts->seed = 38290;
+	opts->trace = 0;
+}
+
+int workload_parse_option( struct workload_options *opts, const char *arg )
+{
+	const char *value = strchr(arg,'=');
+	size_t keylen;
+
+	if(!value) return 0;
+	keylen = value - arg;
+	value++;
+
+#define KEY(k) (keylen==strlen(k) && !strncmp(arg,k,keylen))
+
+	if(KEY("theta")) {
+		opts->theta = atof(value);
+		return (opts->theta>=0 && opts->theta<1) ? 1 : -1;
+	} else if(KEY("ops")) {
+		opts->ops = atol(value);
+		return opts->ops>=0 ? 1 : -1;
+	} else if(KEY("writes")) {
+		opts->write_pct = atoi(value);
+		return (opts->write_pct>=0 && opts->write_pct<=100) ? 1 : -1;
+	} else if(KEY("stride")) {
+		opts->stride = atoi(value);
+		return opts->stride>0 ? 1 : -1;
+	} else if(KEY("span")) {
+		opts->span = atoi(value);
+		return opts->span>=0 ? 1 : -1;
+	} else if(KEY("loops")) {
+		opts->loops = atoi(value);
+		return opts->loops>0 ? 1 : -1;
+	} else if(KEY("dim")) {
+		opts->dim = atoi(value);
+		return opts->dim>=0 ? 1 : -1;
+	} else if(KEY("block")) {
+		opts->block = atoi(value);
+		return opts->block>0 ? 1 : -1;
+	} else if(KEY("phases")) {
+		opts->phases = atoi(value);
+		return opts->phases>0 ? 1 : -1;
+	} else if(KEY("seed")) {
+		opts->seed = atol(value);
+		return 1;
+	} else if(KEY("trace")) {
+		opts->trace = value;
+		return value[0] ? 1 : -1;
+	}
+
+#undef KEY
+
+	return 0;
+}
+
+int workload_run( const char *name, char *data, long length, const struct workload_options *opts )
+{
+	long npages = length / PAGE_SIZE;
+	long dim;
+	int total;
+
+	rng_seed(opts->seed);
+
+	if(!strcmp(name,"zipf")) {
+		total = zipf_workload(data,npages,opts);
+	} else if(!strcmp(name,"uniform")) {
+		total = uniform_workload(data,npages,opts);
+	} else if(!strcmp(name,"stride")) {
+		total = stride_workload(data,length,opts);
+	} else if(!strcmp(name,"loop")) {
+		total = loop_workload(data,length,opts);
+	} else if(!strcmp(name,"matmul")) {
+		dim = matmul_dim(length,opts);
+		if(dim<0) {
+			return -2;
+		}
+		total = matmul_workload(data,dim,opts);
+	} else if(!strcmp(name,"hash")) {
+		total = hash_workload(data,length,opts);
+	} else if(!strcmp(name,"phase")) {
+		total = phase_workload(data,npages,opts);
+	} else {
+		return -1;
+	}
+
+	printf("%s result is %d\n",name,total);
+	return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+/*
+Synthetic workloads that go beyond the fixed sort/scan/focus programs.
+Each workload is selected by name and tuned with "key=value" arguments
+given after the program name on the virtmem command line.
+*/
+
+struct workload_options {
+	double theta;	/* zipf skew, 0 <= theta < 1 (0 is uniform) */
+	long ops;	/* number of random accesses, 0 picks a default */
+	int write_pct;	/* percentage of accesses that are stores */
+	int stride;	/* bytes between accesses in the stride workload */
+	int span;	/* pages covered by the loop workload, 0 is everything */
+	int loops;	/* passes made by the stride and loop workloads */
+	int dim;	/* matmul matrix dimension, 0 picks the largest that fits */
+	int block;	/* matmul tile size in elements */
+	int phases;	/* number of phases in the phase workload */
+	long seed;	/* random seed */
+	const char *trace;	/* trace file replayed by the trace program */
+};
+
+/* Fill "opts" with the default settings for every workload. */
+
+void workload_options_init( struct workload_options *opts );
+
+/*
+Parse a single "key=value" argument into "opts".
+Returns 1 if the key belongs to the workloads, 0 if it does not,
+and -1 if the key is known but the value is invalid.
+*/
+
+int workload_parse_option( struct workload_options *opts, const char *arg );
+
+/*
+Run the workload called "name" over "length" bytes starting at "data".
+Returns 0 on success, -1 if no workload has that name, or -2 if the
+options do not fit the region (the reason is printed on stderr).
+Known names are zipf, uniform, stride, loop, matmul, hash and phase.
+*/
+
+int workload_run( const char *name, char *data, long length, const struct workload_options *opts );
+
+#endif